@@ -0,0 +1,440 @@
+/**
+ * Micro benchmarks for BinaryTree.
+ * Build with `make bench` (optimized) and run ./bench.
+ */
+
+// {fmt}, if installed, without linking its library
+#define FMT_HEADER_ONLY
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+#include "BinaryTree.hpp"
+#include "ParallelTree.hpp"
+#include "TreeExport.hpp"
+#include "TreeFormat.hpp"
+using namespace ariel;
+
+using bench_clock = chrono::steady_clock;
+
+static double ms_since(bench_clock::time_point start) {
+    return chrono::duration<double, milli>(bench_clock::now() - start).count();
+}
+
+static void report(const string &name, double ms) {
+    cout << left << setw(48) << name << right << setw(10) << fixed << setprecision(2) << ms << " ms" << endl;
+}
+
+/**
+ * A complete tree of n nodes, 0 at the root and i's children at 2i+1, 2i+2.
+ */
+template<typename Tree>
+static Tree complete_tree(int n) {
+    Tree tree;
+    tree.add_root(0);
+    for (int i = 1; i < n; ++i) {
+        if (i % 2 == 1) {
+            tree.add_left((i - 1) / 2, i);
+        } else {
+            tree.add_right((i - 1) / 2, i);
+        }
+    }
+    return tree;
+}
+
+/**
+ * Node allocation: deep copy a tree (one allocation per node) and tear it down.
+ */
+template<typename S>
+static void bench_storage(const string &name, int n, int rounds) {
+    auto source = complete_tree<BinaryTree<int, S>>(n);
+    vector<BinaryTree<int, S>> copies;
+    copies.reserve((size_t) rounds);
+
+    auto start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        copies.emplace_back(source);
+    }
+    report(name + ": build " + to_string(n * rounds) + " nodes", ms_since(start));
+
+    start = bench_clock::now();
+    copies.clear();
+    report(name + ": teardown " + to_string(n * rounds) + " nodes", ms_since(start));
+}
+
+/**
+ * Full in-order walk, repeated.
+ */
+template<typename S, typename Layout = layout::plain, typename Cache = cache::none>
+static void bench_traversal(const string &name, int n, int rounds) {
+    auto tree = complete_tree<BinaryTree<int, S, lookup::scan, Layout, Cache>>(n);
+    long sum = 0;
+    auto start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        for (int v : tree) {
+            sum += v;
+        }
+    }
+    report(name + ": inorder " + to_string(n * rounds) + " nodes", ms_since(start));
+
+    start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        for (auto it = tree.begin_preorder(); it != tree.end_preorder(); ++it) {
+            sum += *it;
+        }
+    }
+    report(name + ": preorder " + to_string(n * rounds) + " nodes", ms_since(start));
+
+    start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        for (auto it = tree.begin_postorder(); it != tree.end_postorder(); ++it) {
+            sum += *it;
+        }
+    }
+    report(name + ": postorder " + to_string(n * rounds) + " nodes", ms_since(start));
+
+    start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        tree.morris_inorder([&](int v) { sum += v; });
+    }
+    report(name + ": morris inorder " + to_string(n * rounds) + " nodes", ms_since(start));
+
+#ifdef ARIEL_HAS_GENERATOR
+    start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        for (int v : tree.inorder()) {
+            sum += v;
+        }
+    }
+    report(name + ": generator inorder " + to_string(n * rounds) + " nodes", ms_since(start));
+#endif
+    if (sum == 42) {
+        cout << sum << endl;
+    }
+}
+
+/**
+ * The zig-zag chain of the "Big tree" test, built by value.
+ */
+template<typename S, typename L>
+static void bench_chain(const string &name, int n) {
+    auto start = bench_clock::now();
+    BinaryTree<int, S, L> tree;
+    tree.add_root(0);
+    for (int i = 0; i < n; ++i) {
+        if (i % 2 == 0) {
+            tree.add_right(i, i + 1);
+        } else {
+            tree.add_left(i, i + 1);
+        }
+    }
+    report(name + ": chain of " + to_string(n) + " nodes", ms_since(start));
+}
+
+/**
+ * The same chain, built through handles.
+ */
+template<typename S>
+static void bench_chain_handles(const string &name, int n) {
+    auto start = bench_clock::now();
+    BinaryTree<int, S> tree;
+    auto h = tree.insert_root(0);
+    for (int i = 0; i < n; ++i) {
+        h = i % 2 == 0 ? tree.insert_right(h, i + 1) : tree.insert_left(h, i + 1);
+    }
+    report(name + ": chain of " + to_string(n) + " nodes", ms_since(start));
+}
+
+/**
+ * Paging: the 100 in-order elements from the middle of a tree.
+ */
+static void bench_paging(int n) {
+    BinaryTree<int, storage::arena, lookup::scan, layout::counted> tree;
+    vector<decltype(tree.insert_root(0))> handles{tree.insert_root(0)};
+    handles.reserve((size_t) n);
+    for (int i = 1; i < n; ++i) {
+        auto parent = handles[(size_t) (i - 1) / 2];
+        handles.push_back(i % 2 == 1 ? tree.insert_left(parent, i) : tree.insert_right(parent, i));
+    }
+    long sum = 0;
+    auto start = bench_clock::now();
+    auto it = tree.begin_inorder();
+    for (int i = 0; i < n / 2; ++i) {
+        ++it;
+    }
+    for (int i = 0; i < 100; ++i, ++it) {
+        sum += *it;
+    }
+    report("paging: step to " + to_string(n / 2), ms_since(start));
+
+    start = bench_clock::now();
+    it = tree.nth_inorder((size_t) n / 2);
+    for (int i = 0; i < 100; ++i, ++it) {
+        sum -= *it;
+    }
+    report("paging: nth_inorder(" + to_string(n / 2) + ")", ms_since(start));
+    if (sum != 0) {
+        cout << "paging mismatch" << endl;
+    }
+}
+
+/**
+ * A random tree of n nodes: each node goes into a random free child slot,
+ * so neighbours in a traversal are far apart in memory.
+ */
+template<typename Tree>
+static Tree random_tree(int n) {
+    Tree tree;
+    using Handle = typename Tree::Handle;
+    vector<pair<Handle, bool>> slots;  // free child slots: parent, left?
+    slots.reserve((size_t) n + 1);
+    Handle root = tree.insert_root(0);
+    slots.emplace_back(root, true);
+    slots.emplace_back(root, false);
+    mt19937 random(42);
+    for (int i = 1; i < n; ++i) {
+        size_t k = random() % slots.size();
+        auto [parent, left] = slots[k];
+        slots[k] = slots.back();
+        slots.pop_back();
+        Handle h = left ? tree.insert_left(parent, i) : tree.insert_right(parent, i);
+        slots.emplace_back(h, true);
+        slots.emplace_back(h, false);
+    }
+    return tree;
+}
+
+/**
+ * Traversals and a full search (of a missing value) over a random tree,
+ * without and with prefetching.
+ */
+template<typename S>
+static void bench_prefetch(const string &name, int n) {
+    auto tree = random_tree<BinaryTree<int, S>>(n);
+    long sum = 0;
+    auto start = bench_clock::now();
+    for (int v : tree) {
+        sum += v;
+    }
+    report(name + ": inorder " + to_string(n) + " random nodes", ms_since(start));
+
+    start = bench_clock::now();
+    for (auto it = tree.begin_preorder(); it != tree.end_preorder(); ++it) {
+        sum += *it;
+    }
+    report(name + ": preorder " + to_string(n) + " random nodes", ms_since(start));
+
+    start = bench_clock::now();
+    bool found = static_cast<bool>(tree.handle_of(-1));
+    report(name + ": search " + to_string(n) + " random nodes", ms_since(start));
+    if (found || sum == 42) {
+        cout << sum << endl;
+    }
+}
+
+/**
+ * All three orders of a random tree: three iterator passes against one
+ * Euler tour.
+ */
+static void bench_euler(int n, int rounds) {
+    auto tree = random_tree<BinaryTree<int, storage::arena>>(n);
+    long pre = 0, in = 0, post = 0;
+    auto start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        long k = 0;
+        for (auto it = tree.begin_preorder(); it != tree.end_preorder(); ++it) {
+            pre += *it * ++k;
+        }
+        k = 0;
+        for (auto it = tree.begin_inorder(); it != tree.end_inorder(); ++it) {
+            in += *it * ++k;
+        }
+        k = 0;
+        for (auto it = tree.begin_postorder(); it != tree.end_postorder(); ++it) {
+            post += *it * ++k;
+        }
+    }
+    report("euler: three passes over " + to_string(n * rounds), ms_since(start));
+
+    struct Sums {
+        long pre = 0, in = 0, post = 0, kpre = 0, kin = 0, kpost = 0;
+
+        void on_enter(int v, size_t /*depth*/) { pre += v * ++kpre; }
+
+        void on_between(int v, size_t /*depth*/) { in += v * ++kin; }
+
+        void on_exit(int v, size_t /*depth*/) { post += v * ++kpost; }
+    };
+    Sums sums;
+    start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        sums.kpre = sums.kin = sums.kpost = 0;
+        tree.euler_tour(sums);
+    }
+    report("euler: one euler_tour over " + to_string(n * rounds), ms_since(start));
+    if (pre != sums.pre || in != sums.in || post != sums.post) {
+        cout << "euler mismatch" << endl;
+    }
+}
+
+/**
+ * Dump a random tree with the box drawing printer, bounded and not, and
+ * the exporters.
+ */
+static void bench_export(int n) {
+    const auto tree = random_tree<BinaryTree<int, storage::arena>>(n);
+    auto dump = [&](const string &name, const function<void(ostream &)> &write) {
+        ostringstream os;
+        auto start = bench_clock::now();
+        write(os);
+        report("export: " + name + " of " + to_string(n), ms_since(start));
+    };
+    dump("operator<<", [&](ostream &os) { os << tree; });
+    dump("print 6 levels, 1000 nodes", [&](ostream &os) { tree.print(os, {.max_depth = 6, .max_nodes = 1000}); });
+    dump("dot", [&](ostream &os) { write_dot(os, tree); });
+    dump("json", [&](ostream &os) { write_json(os, tree); });
+    dump("brackets", [&](ostream &os) { write_brackets(os, tree); });
+#ifdef ARIEL_HAS_FMT
+    // to a string, where a stream needs a copy out of the ostringstream
+    for (const char *spec : {"{}", "{:json}"}) {
+        auto start = bench_clock::now();
+        string text = fmt::format(fmt::runtime(spec), tree);
+        report("export: fmt::format " + string(spec) + " of " + to_string(n), ms_since(start));
+    }
+#endif
+}
+
+/**
+ * Save a random tree and load it back, against rebuilding it by value with
+ * add_left/add_right, as a load from the source data would.
+ */
+static void bench_serialize(int n, int replayed) {
+    auto tree = random_tree<BinaryTree<int, storage::arena>>(n);
+    stringstream data;
+    auto start = bench_clock::now();
+    tree.serialize(data);
+    report("serialize: save " + to_string(n), ms_since(start));
+    BinaryTree<int, storage::arena> loaded;
+    start = bench_clock::now();
+    loaded.deserialize(data);
+    report("serialize: load " + to_string(n), ms_since(start));
+
+    const auto small = random_tree<BinaryTree<int, storage::arena>>(replayed);
+    vector<tuple<int, int, bool>> edges;  // parent, child, left? - in preorder
+    using Cursor = decltype(small.root_cursor());
+    vector<Cursor> stack{small.root_cursor()};
+    while (!stack.empty()) {
+        Cursor c = stack.back();
+        stack.pop_back();
+        for (auto [child, left] : {pair{c.right(), false}, pair{c.left(), true}}) {
+            if (child) {
+                edges.emplace_back(*c, *child, left);
+                stack.push_back(child);
+            }
+        }
+    }
+    start = bench_clock::now();
+    BinaryTree<int, storage::arena> replay;
+    replay.add_root(*small.root_cursor());
+    for (auto [parent, child, left] : edges) {
+        left ? replay.add_left(parent, child) : replay.add_right(parent, child);
+    }
+    report("serialize: add_left/add_right " + to_string(replayed), ms_since(start));
+    stringstream small_data;
+    small.serialize(small_data);
+    start = bench_clock::now();
+    replay.deserialize(small_data);
+    report("serialize: load " + to_string(replayed), ms_since(start));
+}
+
+/**
+ * Preorder sum, one value per operator++ against batches of 256 values.
+ */
+static void bench_batch(int n, int rounds) {
+    auto tree = complete_tree<BinaryTree<int, storage::arena>>(n);
+    long sum = 0;
+    auto start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        for (auto it = tree.begin_preorder(); it != tree.end_preorder(); ++it) {
+            sum += *it;
+        }
+    }
+    report("batch: preorder loop over " + to_string(n * rounds), ms_since(start));
+
+    start = bench_clock::now();
+    long batched = 0;
+    array<int, 256> values{};
+    for (int i = 0; i < rounds; ++i) {
+        auto it = tree.begin_preorder();
+        while (size_t got = it.next_batch(span<int>{values})) {
+            for (size_t k = 0; k < got; ++k) {
+                batched += values[k];
+            }
+        }
+    }
+    report("batch: preorder next_batch(256) over " + to_string(n * rounds), ms_since(start));
+    if (sum != batched) {
+        cout << "batch mismatch" << endl;
+    }
+}
+
+/**
+ * Sum of a 4M-node tree: iterator loop against parallel_reduce.
+ */
+static void bench_reduce(int n) {
+    auto tree = complete_tree<BinaryTree<long, storage::arena, lookup::hashed>>(n);
+    auto start = bench_clock::now();
+    long sum = 0;
+    for (long v : tree) {
+        sum += v;
+    }
+    report("reduce: inorder loop over " + to_string(n), ms_since(start));
+
+    start = bench_clock::now();
+    long parallel = parallel_reduce(tree, 0L, plus<>{});
+    report("reduce: parallel_reduce over " + to_string(n) + " (" + to_string(thread::hardware_concurrency()) +
+           " threads)", ms_since(start));
+    if (sum != parallel) {
+        cout << "reduce mismatch" << endl;
+    }
+}
+
+int main() {
+    bench_storage<storage::shared>("shared", 10000, 200);
+    bench_storage<storage::arena>("arena", 10000, 200);
+    bench_storage<storage::indexed>("indexed", 10000, 200);
+
+    bench_traversal<storage::shared>("shared", 10000, 200);
+    bench_traversal<storage::arena>("arena", 10000, 200);
+    bench_traversal<storage::indexed>("indexed", 10000, 200);
+    bench_traversal<storage::arena, layout::linked>("arena+linked", 10000, 200);
+    bench_traversal<storage::arena, layout::plain, cache::orders>("arena+cached", 10000, 200);
+
+    bench_chain<storage::arena, lookup::scan>("scan", 20000);
+    bench_chain<storage::arena, lookup::hashed>("hashed", 20000);
+    bench_chain_handles<storage::arena>("handles", 20000);
+    bench_chain_handles<storage::arena>("handles", 10000000);
+
+    bench_paging(2000000);
+    bench_batch(10000, 200);
+
+    bench_prefetch<storage::shared>("shared", 10000000);
+    bench_prefetch<storage::prefetched<storage::shared>>("shared+prefetch", 10000000);
+    bench_prefetch<storage::arena>("arena", 10000000);
+    bench_prefetch<storage::prefetched<storage::arena>>("arena+prefetch", 10000000);
+    bench_euler(10000000, 1);
+    bench_export(2000000);
+    bench_serialize(10000000, 20000);
+    bench_reduce(4000000);
+}
@@ -2,11 +2,25 @@
 // Created by david on 14/05/2021.
 //
 
+// {fmt}, if installed, without linking its library
+#define FMT_HEADER_ONLY
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <ostream>
+#include <ranges>
 #include <set>
+#include <span>
+#include <sstream>
 #include <tuple>
 
 #include "BinaryTree.hpp"
+#include "ParallelTree.hpp"
+#include "TreeExport.hpp"
+#include "TreeFormat.hpp"
 #include "doctest.h"
 
 using namespace ariel;
@@ -18,6 +32,10 @@ void inorder(size_t index, vector<int> &tree, vector<int> &in);
 
 void postorder(size_t index, vector<int> &tree, vector<int> &post);
 
+// a six-node test tree: 1 with children 2 and right, 2 with children 4 and 5, 6 right of 5
+template<class Tree>
+Tree sample_tree(int right = 3);
+
 TEST_CASE("print") {
     BinaryTree<int> bt;
     bt.add_root(0);
@@ -37,6 +55,192 @@ TEST_CASE("print") {
     cout << bt << endl;
 }
 
+TEST_CASE("print layout") {
+    auto bt = sample_tree<BinaryTree<int>>(30);
+    ostringstream os;
+    os << bt;
+    CHECK_EQ(os.str(), "BinaryTree: (size = 6)\n"
+                       " ╗\n"
+                       " ╙── 1╖\n"
+                       "      ╠──30\n"
+                       "      ╙── 2╖\n"
+                       "           ╠── 5╖\n"
+                       "           ║    ╠── 6\n"
+                       "           ╙── 4\n");
+
+    ostringstream empty;
+    empty << BinaryTree<int>{};
+    CHECK_EQ(empty.str(), "BinaryTree: (size = 0)\n╗\n");
+
+    // a deep chain prints without running out of stack
+    BinaryTree<int, storage::arena> chain;
+    auto h = chain.insert_root(0);
+    for (int i = 1; i < 20000; ++i) {
+        h = chain.insert_left(h, i % 10);
+    }
+    ostringstream deep;
+    deep << chain;
+    string lines = deep.str();
+    CHECK_EQ(count(lines.begin(), lines.end(), '\n'), 20002);
+}
+
+TEST_CASE("bounded print") {
+    auto bt = sample_tree<BinaryTree<int, storage::arena, lookup::scan, layout::counted>>(30);
+    auto print = [](const auto &tree, PrintLimits limits) {
+        ostringstream os;
+        tree.print(os, limits);
+        return os.str();
+    };
+    CHECK_EQ(print(bt, {}), print(bt, {.max_depth = 3, .max_nodes = 6}));
+    CHECK_EQ(print(bt, {.max_depth = 1}), "BinaryTree: (size = 6)\n"
+                                          " ╗\n"
+                                          " ╙── 1╖\n"
+                                          "      ╠──30\n"
+                                          "      ╙── 2╖\n"
+                                          "           ╠──... (2 nodes)\n"
+                                          "           ╙──... (1 node)\n");
+    CHECK_EQ(print(bt, {.max_nodes = 2}), "BinaryTree: (size = 6)\n"
+                                          " ╗\n"
+                                          " ╙── 1╖\n"
+                                          "      ╠──30\n"
+                                          "      ╙──... (4 nodes)\n");
+    CHECK_EQ(print(bt, {.max_nodes = 0}), "BinaryTree: (size = 6)\n"
+                                          "╗\n"
+                                          "╙──... (6 nodes)\n");
+
+    // without subtree sizes the summaries have no count
+    BinaryTree<int> plain;
+    plain.add_root(1).add_left(1, 2).add_right(1, 3).add_left(2, 4);
+    CHECK_EQ(print(plain, {.max_depth = 0}), "BinaryTree: (size = 4)\n"
+                                             "╗\n"
+                                             "╙──1╖\n"
+                                             "    ╠──...\n"
+                                             "    ╙──...\n");
+
+    // the width is measured on the printed values only, whether or not the
+    // tree knows its widest value
+    BinaryTree<int> wide;
+    wide.add_root(1).add_left(1, 2).add_left(2, 123456);
+    string before = print(wide, {.max_depth = 1});
+    CHECK_EQ(before, "BinaryTree: (size = 3)\n"
+                     "╗\n"
+                     "╙──1╖\n"
+                     "    ╙──2╖\n"
+                     "        ╙──...\n");
+    for (int &v : wide) {
+        (void) v;
+    }
+    CHECK_EQ(print(wide, {.max_depth = 1}), before);
+    *wide.begin_preorder() = 7;
+    CHECK_EQ(print(wide, {.max_depth = 1}), "BinaryTree: (size = 3)\n"
+                                            "╗\n"
+                                            "╙──7╖\n"
+                                            "    ╙──2╖\n"
+                                            "        ╙──...\n");
+
+    BinaryTree<int, storage::arena, lookup::scan, layout::counted> chain;
+    auto h = chain.insert_root(0);
+    for (int i = 1; i <= 1234; ++i) {
+        h = chain.insert_left(h, i % 10);
+    }
+    CHECK_NE(print(chain, {.max_depth = 0}).find("╙──... (1,234 nodes)\n"), string::npos);
+}
+
+TEST_CASE("print width") {
+    auto header = [](const auto &tree) {
+        ostringstream os;
+        os << tree;
+        string text = os.str();
+        size_t line = text.find('\n') + 1;
+        return text.substr(line, text.find('\n', line) - line);
+    };
+    BinaryTree<int> bt;
+    bt.add_root(-1000).add_left(-1000, 7).add_right(-1000, 42);
+    CHECK_EQ(header(bt), "    ╗");
+    bt.add_root(3);  // the widest value is gone
+    CHECK_EQ(header(bt), " ╗");
+    *bt.begin() = 123456;  // written through an iterator
+    CHECK_EQ(header(bt), "     ╗");
+    bt.at(bt.handle_of(3)) = 1;
+    CHECK_EQ(header(bt), "     ╗");
+    for (int &v : bt) {
+        v = 0;
+    }
+    CHECK_EQ(header(bt), "╗");
+
+    BinaryTree<int> live;
+    live.add_root(1).add_left(1, 2);
+    auto it = live.begin_preorder();
+    CHECK_EQ(header(live), "╗");
+    *it = 123456;  // through an iterator handed out before that print
+    CHECK_EQ(header(live), "     ╗");
+    live.reindex();
+    live.add_left(2, 1234567);
+    CHECK_EQ(header(live), "      ╗");
+
+    BinaryTree<double> reals;
+    reals.add_root(0.5).add_left(0.5, 3.14159265).add_right(0.5, 1e20);
+    CHECK_EQ(header(reals), "      ╗");  // 3.14159 and 1e+20
+
+    BinaryTree<string> words;
+    words.add_root("a").add_left("a", "abcd");
+    BinaryTree<string> copy{words};
+    CHECK_EQ(header(copy), "   ╗");
+}
+
+TEST_CASE("Export") {
+    auto bt = sample_tree<BinaryTree<int>>();
+    ostringstream dot, json, brackets;
+    write_dot(dot, bt);
+    write_json(json, bt);
+    write_brackets(brackets, bt);
+    CHECK_EQ(dot.str(), "digraph BinaryTree {\n"
+                        "n0 [label=\"1\"];\n"
+                        "n1 [label=\"2\"];\nn0:sw -> n1;\n"
+                        "n2 [label=\"4\"];\nn1:sw -> n2;\n"
+                        "n3 [label=\"5\"];\nn1:se -> n3;\n"
+                        "n4 [label=\"6\"];\nn3:se -> n4;\n"
+                        "n5 [label=\"3\"];\nn0:se -> n5;\n"
+                        "}\n");
+    CHECK_EQ(json.str(), R"({"v":1,"l":{"v":2,"l":{"v":4},"r":{"v":5,"r":{"v":6}}},"r":{"v":3}})");
+    CHECK_EQ(brackets.str(), "1(2(4)(5()(6)))(3)");
+
+    BinaryTree<string> words;
+    words.add_root("say \"hi\"").add_left("say \"hi\"", "a(b)\\").add_right("say \"hi\"", "tab\t");
+    ostringstream wdot, wjson, wbrackets;
+    write_dot(wdot, words);
+    write_json(wjson, words);
+    write_brackets(wbrackets, words);
+    CHECK_NE(wdot.str().find(R"(n0 [label="say \"hi\""];)"), string::npos);
+    CHECK_EQ(wjson.str(), R"({"v":"say \"hi\"","l":{"v":"a(b)\\"},"r":{"v":"tab\u0009"}})");
+    CHECK_EQ(wbrackets.str(), "say \"hi\"(a\\(b\\)\\\\)(tab\t)");
+
+    BinaryTree<double> reals;
+    reals.add_root(0.1).add_left(0.1, numeric_limits<double>::infinity());
+    ostringstream rjson;
+    write_json(rjson, reals);
+    CHECK_EQ(rjson.str(), R"({"v":0.1,"l":{"v":null}})");
+
+    ostringstream empty;
+    write_json(empty, BinaryTree<int>{});
+    write_brackets(empty, BinaryTree<int>{});
+    write_dot(empty, BinaryTree<int>{});
+    CHECK_EQ(empty.str(), "nulldigraph BinaryTree {\n}\n");
+
+    // a deep chain exports without running out of stack, in large blocks
+    BinaryTree<int, storage::arena> chain;
+    auto h = chain.insert_root(0);
+    for (int i = 1; i < 100000; ++i) {
+        h = chain.insert_right(h, i);
+    }
+    ostringstream deep;
+    write_brackets(deep, chain);
+    string text = deep.str();
+    CHECK_EQ(count(text.begin(), text.end(), '('), 2 * 99999);
+    CHECK_EQ(count(text.begin(), text.end(), ')'), 2 * 99999);
+    CHECK_NE(text.find("99998()(99999))"), string::npos);
+}
+
 class MyInt {
     int x;
 
@@ -162,6 +366,53 @@ TEST_CASE("Big tree") {
     }
 }
 
+TEST_CASE_TEMPLATE("Deep chain", S, storage::shared, storage::arena, storage::indexed) {
+    const int depth = 200000;
+    BinaryTree<int, S, lookup::hashed> bt;
+    bt.add_root(0);
+    for (int i = 0; i < depth; ++i) {
+        bt.add_left(i, i + 1);
+    }
+    bt.add_right(depth, depth);       // two nodes hold depth - the next lookup searches
+    CHECK_NOTHROW(bt.add_left(depth, -1));  // at the deepest node, the first in preorder
+    CHECK_EQ(*bt.begin_inorder(), -1);
+    int count = 0;
+    for (auto it = bt.begin_postorder(); it != bt.end_postorder(); ++it) {
+        ++count;
+    }
+    CHECK_EQ(count, depth + 3);
+    BinaryTree<int, S, lookup::hashed> copy{bt};
+    CHECK_EQ(*copy.begin_preorder(), 0);
+}
+
+TEST_CASE_TEMPLATE("Handles", S, storage::shared, storage::arena, storage::indexed) {
+    BinaryTree<int, S> bt;
+    auto root = bt.insert_root(1);
+    auto nine = bt.insert_left(root, 9);
+    bt.insert_left(nine, 4);
+    bt.insert_right(nine, 5);
+    bt.insert_right(root, 3);
+    auto two = bt.insert_left(root, 2);  // overwrites 9, its children stay
+    CHECK(two == nine);
+    CHECK_EQ(bt.at(two), 2);
+    CHECK_EQ(bt.at(bt.handle_of(5)), 5);
+    CHECK_FALSE(bt.handle_of(9));
+    CHECK_THROWS(bt.insert_left(bt.handle_of(9), 1));
+    vector<int> pre;
+    for (auto it = bt.begin_preorder(); it != bt.end_preorder(); ++it) {
+        pre.push_back(*it);
+    }
+    CHECK_EQ(pre, vector<int>{1, 2, 4, 5, 3});
+
+    BinaryTree<int, S> chain;
+    auto h = chain.insert_root(0);
+    for (int i = 1; i < 100000; ++i) {
+        h = i % 2 == 0 ? chain.insert_left(h, i) : chain.insert_right(h, i);
+    }
+    CHECK_EQ(chain.at(h), 99999);
+    CHECK_EQ(*chain.begin_postorder(), 99999);
+}
+
 TEST_CASE("Not existing values") {
     BinaryTree<int> bt;
     bt.add_root(0);
@@ -261,6 +512,701 @@ TEST_CASE("Iterators") {
     }
 }
 
+TEST_CASE_TEMPLATE("Morris traversal", S, storage::shared, storage::arena, storage::indexed) {
+    for (int k = 0; k < 20; ++k) {
+        BinaryTree<int, S> bt;
+        auto root = bt.insert_root(0);
+        vector<typename BinaryTree<int, S>::Handle> handles{root};
+        for (int i = 1; i < 200; ++i) {
+            auto parent = handles[(size_t) rand() % handles.size()];
+            handles.push_back(rand() % 2 == 0 ? bt.insert_left(parent, i) : bt.insert_right(parent, i));
+        }
+        vector<int> pre, in, morris_pre, morris_in;
+        for (auto it = bt.begin_preorder(); it != bt.end_preorder(); ++it) {
+            pre.push_back(*it);
+        }
+        for (int i : bt) {
+            in.push_back(i);
+        }
+        bt.morris_inorder([&](int v) { morris_in.push_back(v); });
+        bt.morris_preorder([&](int v) { morris_pre.push_back(v); });
+        CHECK_EQ(morris_in, in);
+        CHECK_EQ(morris_pre, pre);
+
+        // a throwing visitor leaves the tree as it was
+        int visited = 0;
+        CHECK_THROWS(bt.morris_inorder([&](int) {
+            if (++visited == 50) {
+                throw runtime_error("stop");
+            }
+        }));
+        vector<int> again;
+        for (int i : bt) {
+            again.push_back(i);
+        }
+        CHECK_EQ(again, in);
+    }
+}
+
+TEST_CASE_TEMPLATE("Parent links", S, storage::shared, storage::arena, storage::indexed) {
+    for (int k = 0; k < 20; ++k) {
+        BinaryTree<int, S> plain;
+        BinaryTree<int, S, lookup::scan, layout::linked> linked;
+        vector<typename BinaryTree<int, S>::Handle> plain_handles{plain.insert_root(0)};
+        vector<typename BinaryTree<int, S, lookup::scan, layout::linked>::Handle> linked_handles{
+                linked.insert_root(0)};
+        for (int i = 1; i < 100; ++i) {
+            auto parent = (size_t) rand() % plain_handles.size();
+            if (rand() % 2 == 0) {
+                plain_handles.push_back(plain.insert_left(plain_handles[parent], i));
+                linked_handles.push_back(linked.insert_left(linked_handles[parent], i));
+            } else {
+                plain_handles.push_back(plain.insert_right(plain_handles[parent], i));
+                linked_handles.push_back(linked.insert_right(linked_handles[parent], i));
+            }
+        }
+        BinaryTree<int, S, lookup::scan, layout::linked> copy{linked};
+        auto check_order = [](auto plain_begin, auto plain_end, auto begin, auto end) {
+            vector<int> expected, forward, backward;
+            for (auto it = plain_begin; it != plain_end; ++it) {
+                expected.push_back(*it);
+            }
+            for (auto it = begin; it != end; it++) {
+                forward.push_back(*it);
+            }
+            for (auto it = end; it != begin;) {
+                backward.insert(backward.begin(), *--it);
+            }
+            CHECK_EQ(forward, expected);
+            CHECK_EQ(backward, expected);
+        };
+        check_order(plain.begin_preorder(), plain.end_preorder(), copy.begin_preorder(), copy.end_preorder());
+        check_order(plain.begin_inorder(), plain.end_inorder(), copy.begin_inorder(), copy.end_inorder());
+        check_order(plain.begin_postorder(), plain.end_postorder(), copy.begin_postorder(), copy.end_postorder());
+    }
+}
+
+TEST_CASE("Const iterators") {
+    BinaryTree<int> bt;
+    bt.add_root(1).add_left(1, 2).add_right(1, 3).add_left(2, 4).add_right(2, 5);
+    const BinaryTree<int> &cbt = bt;
+    vector<int> in;
+    for (const int &i : cbt) {
+        in.push_back(i);
+    }
+    CHECK_EQ(in, vector<int>{4, 2, 5, 1, 3});
+    vector<int> pre, post;
+    for (auto it = cbt.cbegin_preorder(); it != cbt.cend_preorder(); ++it) {
+        pre.push_back(*it);
+    }
+    for (auto it = cbt.cbegin_postorder(); it != cbt.cend_postorder(); it++) {
+        post.push_back(*it);
+    }
+    CHECK_EQ(pre, vector<int>{1, 2, 4, 5, 3});
+    CHECK_EQ(post, vector<int>{4, 5, 2, 3, 1});
+    static_assert(is_same_v<decltype(*cbt.cbegin()), const int &>);
+
+    BinaryTree<int>::ConstIterator it = bt.begin();  // mutable -> const
+    CHECK(it == bt.begin());
+    CHECK_EQ(*++it, 2);
+
+    BinaryTree<string, storage::arena, lookup::scan, layout::linked> linked;
+    linked.add_root("b").add_left("b", "a").add_right("b", "c");
+    const auto &clinked = linked;
+    auto end = clinked.cend_inorder();
+    CHECK_EQ(*--end, "c");
+    CHECK_EQ(end->size(), 1);
+}
+
+TEST_CASE("Level order") {
+    BinaryTree<int> bt;
+    bt.add_root(1).add_left(1, 2).add_right(1, 3).add_left(2, 4).add_right(2, 5).add_right(3, 7).add_left(7, 8);
+    vector<int> values;
+    vector<size_t> depths;
+    for (auto it = bt.begin_levelorder(); it != bt.end_levelorder(); ++it) {
+        values.push_back(*it);
+        depths.push_back(it.depth());
+    }
+    CHECK_EQ(values, vector<int>{1, 2, 3, 4, 5, 7, 8});
+    CHECK_EQ(depths, vector<size_t>{0, 1, 1, 2, 2, 2, 3});
+
+    // a copy goes on by itself
+    auto it = bt.begin_levelorder();
+    ++it;
+    auto copy = it++;
+    CHECK_EQ(*it, 3);
+    CHECK_EQ(*copy, 2);
+    CHECK_EQ(*++copy, 3);
+
+    // the buffer is reused, not reallocated
+    BinaryTree<int>::LevelBuffer buffer;
+    const auto &cbt = bt;
+    for (int k = 0; k < 2; ++k) {
+        int sum = 0;
+        for (auto i = cbt.cbegin_levelorder(buffer); i != cbt.cend_levelorder(); ++i) {
+            sum += *i;
+        }
+        CHECK_EQ(sum, 30);
+    }
+    CHECK_EQ(buffer.capacity(), 16);
+
+    BinaryTree<int> empty;
+    CHECK(empty.begin_levelorder() == empty.end_levelorder());
+}
+
+TEST_CASE_TEMPLATE("Order statistics", S, storage::shared, storage::arena, storage::indexed) {
+    using Tree = BinaryTree<int, S, lookup::hashed, layout::counted>;
+    for (int k = 0; k < 10; ++k) {
+        Tree built;
+        vector<typename Tree::Handle> handles{built.insert_root(0)};
+        for (int i = 1; i < 150; ++i) {
+            auto parent = handles[(size_t) rand() % handles.size()];
+            handles.push_back(rand() % 2 == 0 ? built.insert_left(parent, i) : built.insert_right(parent, i));
+        }
+        built.add_left(0, -1).add_right(-1, -2);  // sizes kept by value inserts too
+        Tree bt{built};
+        auto check_order = [](auto begin, auto end, auto nth) {
+            vector<int> order;
+            for (auto it = begin; it != end; ++it) {
+                order.push_back(*it);
+            }
+            REQUIRE(order.size() > 8);
+            for (size_t i = 0; i < order.size(); ++i) {
+                CHECK_EQ(*nth(i), order[i]);
+            }
+            CHECK(nth(order.size()) == end);
+            auto it = begin;
+            it.advance(7);
+            CHECK_EQ(*it, order[7]);
+            it.advance(-5);
+            CHECK_EQ(*it, order[2]);
+            it.advance(-3);
+            CHECK(it == end);
+            it = begin;
+            it.advance((ptrdiff_t) order.size() - 1);
+            CHECK_EQ(*it, order.back());
+        };
+        check_order(bt.begin_preorder(), bt.end_preorder(), [&](size_t i) { return bt.nth_preorder(i); });
+        check_order(bt.begin_inorder(), bt.end_inorder(), [&](size_t i) { return bt.nth_inorder(i); });
+        check_order(bt.begin_postorder(), bt.end_postorder(), [&](size_t i) { return bt.nth_postorder(i); });
+    }
+}
+
+TEST_CASE("Parallel for_each and reduce") {
+    // a long chain with bushes hanging off it - lopsided on purpose
+    BinaryTree<long, storage::arena> bt;
+    auto h = bt.insert_root(0);
+    long n = 1;
+    for (int i = 0; i < 2000; ++i) {
+        auto bush = bt.insert_right(h, n++);
+        for (int j = 0; j < i % 50; ++j) {
+            bush = bt.insert_left(bush, n++);
+        }
+        h = bt.insert_left(h, n++);
+    }
+    long expected = n * (n - 1) / 2;
+    for (unsigned threads : {1u, 2u, 4u, 0u}) {
+        CHECK_EQ(parallel_reduce(bt, 0L, plus<>{}, threads), expected);
+    }
+    const auto &cbt = bt;
+    CHECK_EQ(parallel_reduce(cbt, 10L, plus<>{}), expected + 10);
+
+    parallel_for_each(bt, [](long &v) { v *= 2; }, 4);
+    CHECK_EQ(parallel_reduce(bt, 0L, plus<>{}, 4), 2 * expected);
+
+    atomic<long> count{0};
+    parallel_for_each(cbt, [&](const long &) { ++count; });
+    CHECK_EQ(count.load(), n);
+
+    CHECK_THROWS_AS(parallel_for_each(bt, [](long &v) {
+        if (v == 1000) {
+            throw invalid_argument("1000");
+        }
+    }, 4), invalid_argument);
+
+    BinaryTree<long> empty;
+    CHECK_EQ(parallel_reduce(empty, 7L, plus<>{}), 7);
+    CHECK_EQ(parallel_transform_reduce(empty, 7L, plus<>{}, [](long v) { return v * v; }), 7);
+
+    BinaryTree<int> small;
+    small.add_root(3).add_left(3, 4);
+    for (unsigned threads : {1u, 2u}) {
+        CHECK_EQ(parallel_transform_reduce(small, 0, plus<>{}, [](int v) { return v * v; }, threads), 25);
+    }
+
+    // a histogram of the last digits
+    using Histogram = map<long, long>;
+    auto merge = [](Histogram a, Histogram b) {
+        if (a.size() < b.size()) {
+            swap(a, b);
+        }
+        for (auto [digit, count] : b) {
+            a[digit] += count;
+        }
+        return a;
+    };
+    auto digit = [](long v) { return Histogram{{v % 10, 1}}; };
+    Histogram expected_digits;
+    for (long v : cbt) {
+        ++expected_digits[v % 10];
+    }
+    for (unsigned threads : {1u, 4u}) {
+        CHECK_EQ(parallel_transform_reduce(bt, Histogram{}, merge, digit, threads), expected_digits);
+    }
+    CHECK_EQ(parallel_transform_reduce(cbt, Histogram{{0, 1}}, merge, digit)[0], expected_digits[0] + 1);
+}
+
+TEST_CASE_TEMPLATE("Flat views", S, storage::shared, storage::arena, storage::indexed) {
+    auto bt = sample_tree<BinaryTree<int, S>>();
+    auto two = bt.handle_of(2);
+
+    static_assert(random_access_iterator<typename FlatView<int>::iterator>);
+    static_assert(random_access_iterator<typename FlatView<const int>::iterator>);
+
+    auto pre = bt.flatten(Order::pre);
+    CHECK(vector<int>(pre.begin(), pre.end()) == vector<int>{1, 2, 4, 5, 6, 3});
+    auto in = bt.flatten(Order::in);
+    CHECK(vector<int>(in.begin(), in.end()) == vector<int>{4, 2, 5, 6, 1, 3});
+    auto post = bt.flatten(Order::post);
+    CHECK(vector<int>(post.begin(), post.end()) == vector<int>{4, 6, 5, 2, 3, 1});
+    CHECK_EQ(post.size(), 6);
+    CHECK_EQ(post[3], 2);
+    CHECK_EQ(post.end() - post.begin(), 6);
+    CHECK_EQ(*(post.begin() + 4), 3);
+
+    auto sub = bt.flatten(Order::post, two);
+    CHECK(vector<int>(sub.begin(), sub.end()) == vector<int>{4, 6, 5, 2});
+
+    // writes go through to the tree
+    for_each(pre.begin(), pre.end(), [](int &v) { v *= 10; });
+    CHECK_EQ(reduce(in.begin(), in.end()), 210);
+    CHECK_EQ(bt.at(two), 20);
+    sort(in.begin(), in.end(), greater<>{});
+    auto sorted = bt.flatten(Order::in);
+    CHECK(vector<int>(sorted.begin(), sorted.end()) == vector<int>{60, 50, 40, 30, 20, 10});
+
+    const auto &cbt = bt;
+    auto view = cbt.flatten(Order::in);
+    CHECK_EQ(*max_element(view.begin(), view.end()), 60);
+    CHECK(BinaryTree<int, S>{}.flatten(Order::pre).empty());
+    CHECK_THROWS(bt.flatten(Order::pre, typename BinaryTree<int, S>::Handle{}));
+}
+
+TEST_CASE_TEMPLATE("Cached orders", S, storage::shared, storage::arena, storage::indexed) {
+    using Tree = BinaryTree<int, S, lookup::hashed, layout::plain, cache::orders>;
+    Tree bt;
+    BinaryTree<int, S> plain;
+    auto h = bt.insert_root(0);
+    auto p = plain.insert_root(0);
+    auto same_orders = [&] {
+        vector<int> a, b;
+        for (auto it = bt.begin_preorder(); it != bt.end_preorder(); ++it) {
+            a.push_back(*it);
+        }
+        for (auto it = plain.begin_preorder(); it != plain.end_preorder(); ++it) {
+            b.push_back(*it);
+        }
+        for (auto it = bt.begin_inorder(); it != bt.end_inorder(); ++it) {
+            a.push_back(*it);
+        }
+        for (auto it = plain.begin_inorder(); it != plain.end_inorder(); ++it) {
+            b.push_back(*it);
+        }
+        for (auto it = bt.begin_postorder(); it != bt.end_postorder(); ++it) {
+            a.push_back(*it);
+        }
+        for (auto it = plain.begin_postorder(); it != plain.end_postorder(); ++it) {
+            b.push_back(*it);
+        }
+        return a == b;
+    };
+    CHECK(same_orders());
+    for (int i = 1; i < 300; ++i) {  // every insert invalidates the cache
+        bool left = rand() % 2 == 0;
+        h = left ? bt.insert_left(h, i) : bt.insert_right(h, i);
+        p = left ? plain.insert_left(p, i) : plain.insert_right(p, i);
+        if (i % 3 == 0) {
+            bt.add_left(i, -i);
+            plain.add_left(i, -i);
+        }
+        if (i % 50 == 0) {
+            REQUIRE(same_orders());
+        }
+    }
+    CHECK(same_orders());
+
+    // writes through cached iterators reach the tree
+    for (int &v : bt) {
+        v *= 2;
+    }
+    CHECK_EQ(bt.at(h), 2 * 299);
+    CHECK_EQ(*bt.nth_preorder(0), 0);
+    CHECK_EQ(*bt.nth_preorder(1), *++bt.begin_preorder());
+    CHECK(bt.nth_inorder(100000) == bt.end_inorder());
+
+    const Tree &cbt = bt;
+    typename Tree::ConstIterator it = bt.begin();
+    CHECK(it == cbt.begin());
+    int sum = 0;
+    for (int v : plain) {
+        sum += v;
+    }
+    CHECK_EQ(accumulate(cbt.begin(), cbt.end(), 0), 2 * sum);
+
+    Tree copy{bt};
+    copy.add_root(7);
+    CHECK_EQ(*copy.begin_preorder(), 7);
+    CHECK_EQ(*bt.begin_preorder(), 0);
+    Tree moved{std::move(copy)};
+    CHECK_EQ(*moved.begin_preorder(), 7);
+    CHECK(copy.begin_preorder() == copy.end_preorder());
+    copy = bt;
+    CHECK_EQ(*copy.begin_preorder(), 0);
+
+    // room made for a node that is never created may still move the nodes
+    Tree small;
+    small.add_root(1).add_left(1, 2);
+    CHECK_EQ(vector<int>(small.begin_preorder(), small.end_preorder()), vector<int>{1, 2});
+    CHECK_THROWS(small.add_left(42, 3));
+    small.add_left(1, 5);
+    CHECK_EQ(vector<int>(small.begin_preorder(), small.end_preorder()), vector<int>{1, 5});
+    small.reserve(1000);
+    small.add_right(1, 6);
+    CHECK_EQ(vector<int>(small.begin_preorder(), small.end_preorder()), vector<int>{1, 5, 6});
+}
+
+TEST_CASE_TEMPLATE("Batch traversal", Tree, BinaryTree<int>, BinaryTree<int, storage::arena, lookup::scan, layout::linked>,
+                   BinaryTree<int, storage::indexed, lookup::scan, layout::plain, cache::orders>) {
+    Tree bt;
+    auto h = bt.insert_root(0);
+    for (int i = 1; i < 100; ++i) {
+        h = i % 3 == 0 ? bt.insert_left(h, i) : bt.insert_right(h, i);
+        bt.insert_left(h, 1000 + i);
+    }
+    auto check_batches = [](auto begin, auto end, auto batches) {
+        vector<int> expected;
+        for (auto it = begin; it != end; ++it) {
+            expected.push_back(*it);
+        }
+        vector<int> got;
+        auto it = begin;
+        array<int *, 16> pointers{};
+        size_t n;
+        while ((n = it.next_batch(span<int *>{pointers})) > 0) {
+            for (size_t i = 0; i < n; ++i) {
+                got.push_back(*pointers[i]);
+            }
+        }
+        CHECK(it == end);
+        CHECK_EQ(got, expected);
+        CHECK_EQ(it.next_batch(span<int *>{pointers}), 0);
+
+        got.clear();
+        it = begin;
+        vector<int> values((size_t) batches);
+        while ((n = it.next_batch(span<int>{values})) > 0) {
+            got.insert(got.end(), values.begin(), values.begin() + (ptrdiff_t) n);
+        }
+        CHECK_EQ(got, expected);
+    };
+    check_batches(bt.begin_preorder(), bt.end_preorder(), 7);
+    check_batches(bt.begin_inorder(), bt.end_inorder(), 64);
+    check_batches(bt.begin_postorder(), bt.end_postorder(), 1000);
+    check_batches(bt.begin_levelorder(), bt.end_levelorder(), 10);
+
+    const Tree &cbt = bt;
+    auto it = cbt.cbegin_preorder();
+    array<const int *, 4> pointers{};
+    CHECK_EQ(it.next_batch(span<const int *>{pointers}), 4);
+    CHECK_EQ(*pointers[0], 0);
+    auto fifth = cbt.cbegin_preorder();
+    for (int i = 0; i < 4; ++i) {
+        CHECK_EQ(*pointers[(size_t) i], *fifth);
+        ++fifth;
+    }
+    CHECK(it == fifth);
+}
+
+#ifdef ARIEL_HAS_GENERATOR
+Generator<const int &> count_to(int n) {
+    for (int i = 1; i <= n; ++i) {
+        if (i == 3) {
+            throw invalid_argument("3");
+        }
+        co_yield i;
+    }
+}
+
+TEST_CASE_TEMPLATE("Generators", S, storage::shared, storage::arena, storage::indexed) {
+    auto bt = sample_tree<BinaryTree<int, S, lookup::scan, layout::linked>>();
+    auto two = bt.handle_of(2);
+
+    auto collect = [](auto &&range) {
+        vector<int> out;
+        for (int v : range) {
+            out.push_back(v);
+        }
+        return out;
+    };
+    CHECK_EQ(collect(bt.preorder()), vector<int>{1, 2, 4, 5, 6, 3});
+    CHECK_EQ(collect(bt.inorder()), vector<int>{4, 2, 5, 6, 1, 3});
+    CHECK_EQ(collect(bt.postorder()), vector<int>{4, 6, 5, 2, 3, 1});
+    CHECK_EQ(collect(BinaryTree<int, S>{}.inorder()), vector<int>{});
+
+    static_assert(ranges::input_range<Generator<int &>>);
+    static_assert(ranges::view<Generator<int &>>);
+    auto odd_doubled = bt.inorder() | views::filter([](int v) { return v % 2 == 1; }) |
+                       views::transform([](int v) { return 2 * v; });
+    CHECK_EQ(collect(odd_doubled), vector<int>{10, 2, 6});
+
+    for (int &v : bt.postorder()) {
+        v += 10;
+    }
+    CHECK_EQ(bt.at(two), 12);
+    const auto &cbt = bt;
+    auto gen = cbt.preorder();
+    auto it = gen.begin();
+    CHECK_EQ(*it, 11);
+    ++it;
+    CHECK_EQ(*it, 12);
+
+    vector<int> seen;
+    CHECK_THROWS_AS(
+            for (int v : count_to(5)) { seen.push_back(v); }, invalid_argument);
+    CHECK_EQ(seen, vector<int>{1, 2});
+}
+#endif
+
+TEST_CASE_TEMPLATE("Ranges views", Tree, BinaryTree<int>, BinaryTree<int, storage::arena, lookup::scan, layout::linked>,
+                   BinaryTree<int, storage::indexed, lookup::scan, layout::plain, cache::orders>) {
+    static_assert(forward_iterator<typename Tree::PreorderIterator>);
+    static_assert(forward_iterator<typename Tree::ConstPostorderIterator>);
+    static_assert(sentinel_for<typename Tree::template OrderEnd<Order::in>, typename Tree::InorderIterator>);
+    static_assert(ranges::view<typename Tree::template OrderView<Order::pre>>);
+    static_assert(ranges::forward_range<typename Tree::template OrderView<Order::in, true>>);
+    static_assert(input_iterator<typename Tree::template LevelIterator<>>);
+
+    auto bt = sample_tree<Tree>();
+
+    auto collect = [](auto &&range) {
+        vector<int> out;
+        for (int v : range) {
+            out.push_back(v);
+        }
+        return out;
+    };
+    CHECK_EQ(collect(bt.preorder_view()), vector<int>{1, 2, 4, 5, 6, 3});
+    CHECK_EQ(collect(bt.inorder_view()), vector<int>{4, 2, 5, 6, 1, 3});
+    CHECK_EQ(collect(bt.postorder_view()), vector<int>{4, 6, 5, 2, 3, 1});
+
+    auto evens = bt.preorder_view() | views::filter([](int v) { return v % 2 == 0; }) | views::take(2);
+    CHECK_EQ(collect(evens), vector<int>{2, 4});
+    CHECK_EQ(ranges::distance(bt.postorder_view()), 6);
+    CHECK_EQ(*ranges::max_element(bt.inorder_view()), 6);
+    CHECK(ranges::find(bt.inorder_view(), 7) == bt.end_inorder());
+
+    for (int &v : bt.inorder_view() | views::take(3)) {
+        v = -v;
+    }
+    const Tree &cbt = bt;
+    CHECK_EQ(collect(cbt.inorder_view() | views::transform([](int v) { return v * 10; })),
+             vector<int>{-40, -20, -50, 60, 10, 30});
+    CHECK(ranges::empty(Tree{}.preorder_view()));
+    CHECK_EQ(*next(bt.begin_postorder(), 2), -5);
+}
+
+struct OrderRecorder {
+    vector<int> pre, in, post;
+    vector<size_t> depths, sizes;
+
+    void on_enter(int v, size_t depth) {
+        pre.push_back(v);
+        depths.push_back(depth);
+    }
+
+    void on_between(int v, size_t /*depth*/) { in.push_back(v); }
+
+    void on_exit(int v, size_t /*depth*/, size_t size) {
+        post.push_back(v);
+        sizes.push_back(size);
+    }
+};
+
+TEST_CASE_TEMPLATE("Euler tour", S, storage::shared, storage::arena, storage::indexed) {
+    auto bt = sample_tree<BinaryTree<int, S>>();
+    auto two = bt.handle_of(2);
+
+    OrderRecorder rec;
+    bt.euler_tour(rec);
+    CHECK_EQ(rec.pre, vector<int>{1, 2, 4, 5, 6, 3});
+    CHECK_EQ(rec.in, vector<int>{4, 2, 5, 6, 1, 3});
+    CHECK_EQ(rec.post, vector<int>{4, 6, 5, 2, 3, 1});
+    CHECK_EQ(rec.depths, vector<size_t>{0, 1, 2, 2, 3, 1});
+    CHECK_EQ(rec.sizes, vector<size_t>{1, 1, 2, 4, 1, 6});
+
+    // only the callbacks the visitor has are called
+    struct Doubler {
+        void on_exit(int &v, size_t /*depth*/) { v *= 2; }
+    };
+    bt.euler_tour(Doubler{});
+    CHECK_EQ(bt.at(two), 4);
+
+    // agrees with the iterators on a bigger tree, and doesn't overflow on a deep one
+    BinaryTree<int, S> big;
+    auto h = big.insert_root(0);
+    for (int i = 1; i < 100000; ++i) {
+        h = i % 3 == 0 ? big.insert_left(h, i) : big.insert_right(h, i);
+        big.insert_left(h, -i);
+    }
+    OrderRecorder all;
+    const auto &cbig = big;
+    cbig.euler_tour(all);
+    vector<int> pre, in, post;
+    for (auto it = big.begin_preorder(); it != big.end_preorder(); ++it) {
+        pre.push_back(*it);
+    }
+    for (int v : big) {
+        in.push_back(v);
+    }
+    for (auto it = big.begin_postorder(); it != big.end_postorder(); ++it) {
+        post.push_back(*it);
+    }
+    CHECK(all.pre == pre);
+    CHECK(all.in == in);
+    CHECK(all.post == post);
+    CHECK_EQ(all.sizes.back(), pre.size());
+
+    BinaryTree<int, S> empty;
+    OrderRecorder none;
+    empty.euler_tour(none);
+    CHECK(none.pre.empty());
+}
+
+#if defined(ARIEL_HAS_STD_FORMAT) || defined(ARIEL_HAS_FMT)
+// the same checks through std::format and {fmt}, whichever are there
+template<typename Format>
+void check_tree_format(Format format) {
+    auto bt = sample_tree<BinaryTree<int>>(30);
+    CHECK_EQ(format("{:pre}", bt), "[1, 2, 4, 5, 6, 30]");
+    CHECK_EQ(format("{:in}", bt), "[4, 2, 5, 6, 1, 30]");
+    CHECK_EQ(format("{:post}", bt), "[4, 6, 5, 2, 30, 1]");
+    ostringstream drawn, dot, json, brackets;
+    drawn << bt;
+    write_dot(dot, bt);
+    write_json(json, bt);
+    write_brackets(brackets, bt);
+    CHECK_EQ(format("{}", bt), drawn.str());
+    CHECK_EQ(format("{:tree}", bt), drawn.str());
+    CHECK_EQ(format("{:dot}", bt), dot.str());
+    CHECK_EQ(format("{:json}", bt), json.str());
+    CHECK_EQ(format("{:brackets}", bt), brackets.str());
+    CHECK_EQ(format("{:pre}", BinaryTree<int>{}), "[]");
+    CHECK_THROWS(format("{:level}", bt));
+
+    // values without a formatter go through operator<<
+    BinaryTree<MyInt> mine;
+    mine.add_root(MyInt(7)).add_left(MyInt(7), MyInt(8));
+    CHECK_EQ(format("{:in}", mine), "[8, 7]");
+}
+#endif
+
+#ifdef ARIEL_HAS_STD_FORMAT
+TEST_CASE("std::format") {
+    check_tree_format([](auto spec, const auto &tree) { return std::vformat(spec, std::make_format_args(tree)); });
+}
+#endif
+
+#ifdef ARIEL_HAS_FMT
+TEST_CASE("fmt::format") {
+    check_tree_format([](auto spec, const auto &tree) { return fmt::format(fmt::runtime(spec), tree); });
+    BinaryTree<double> reals;
+    reals.add_root(0.5).add_right(0.5, 0.25);
+    CHECK_EQ(fmt::format("{:pre}", reals), "[0.5, 0.25]");  // spec checked at compile time
+}
+#endif
+
+TEST_CASE_TEMPLATE("Serialize", S, storage::shared, storage::arena, storage::indexed) {
+    auto bt = sample_tree<BinaryTree<int, S, lookup::hashed, layout::counted>>(30);
+    stringstream data;
+    bt.serialize(data);
+    CHECK_EQ(data.str().size(), 4 + 1 + 8 + 2 + 6 * sizeof(int));
+
+    BinaryTree<int, S, lookup::hashed, layout::counted> copy;
+    copy.add_root(99);
+    copy.deserialize(data);
+    vector<int> pre(copy.begin_preorder(), copy.end_preorder());
+    vector<int> post(copy.begin_postorder(), copy.end_postorder());
+    CHECK_EQ(pre, vector<int>{1, 2, 4, 5, 6, 30});
+    CHECK_EQ(post, vector<int>{4, 6, 5, 2, 30, 1});
+    CHECK_EQ(*copy.nth_inorder(3), 6);  // subtree sizes were rebuilt
+    CHECK_NOTHROW(copy.add_left(6, 7));  // and the lookup table
+    CHECK_EQ(*copy.nth_inorder(3), 7);
+    ostringstream before, after;
+    before << bt;
+    copy.at(copy.handle_of(6)) = 6;
+    after << BinaryTree<int, S, lookup::hashed, layout::counted>{bt};
+    CHECK_EQ(before.str(), after.str());
+}
+
+TEST_CASE("Serialize values and errors") {
+    BinaryTree<string> words;
+    words.add_root("").add_left("", "left").add_right("", string(10000, 'x'));
+    struct Point {
+        double x, y;
+    };
+    BinaryTree<Point> points;
+    points.add_root(Point{1.5, -2});
+
+    // one stream can hold several trees
+    stringstream data;
+    words.serialize(data);
+    points.serialize(data);
+    BinaryTree<int>{}.serialize(data);
+    data << "tail";
+    BinaryTree<string> words2;
+    BinaryTree<Point> points2;
+    BinaryTree<int> empty;
+    empty.add_root(1);
+    words2.deserialize(data);
+    points2.deserialize(data);
+    empty.deserialize(data);
+    string tail;
+    data >> tail;
+    CHECK_EQ(tail, "tail");
+    auto loaded = words2.flatten(Order::pre);
+    CHECK_EQ(vector<string>(loaded.begin(), loaded.end()), vector<string>{"", "left", string(10000, 'x')});
+    CHECK_EQ(points2.begin()->x, 1.5);
+    CHECK_EQ(points2.begin()->y, -2);
+    CHECK(empty.begin() == empty.end());
+
+    BinaryTree<int> bt;
+    bt.add_root(1).add_left(1, 2).add_right(1, 3);
+    stringstream good;
+    bt.serialize(good);
+    string bytes = good.str();
+    auto load_into = [](auto tree, const string &text) {
+        tree.add_root(42);
+        istringstream is(text);
+        CHECK_THROWS_AS(tree.deserialize(is), runtime_error);
+        CHECK_EQ(*tree.begin(), 42);  // left as it was
+    };
+    auto load = [&](const string &text) { load_into(BinaryTree<int>{}, text); };
+    load("");
+    load("not a tree at all");
+    load(bytes.substr(0, bytes.size() - 1));  // cut short
+    string extra = bytes;
+    extra[13] = 0;  // root without children, two values left over
+    load(extra);
+    string missing = bytes;
+    missing[13] = 0x3f;  // children for the leaves too
+    load(missing);
+    string huge = bytes;
+    huge.replace(5, 4, 4, '\xff');  // a count of 2^32 - 1 nodes, followed by three
+    load(huge);
+    load_into(BinaryTree<int, storage::arena>{}, huge);
+    load_into(BinaryTree<int, storage::indexed>{}, huge);
+}
+
 TEST_CASE("Copy") {
     BinaryTree<int> bt;
     bt.add_root(0).add_left(0, 1).add_right(0, 2).add_left(1, 3);
@@ -274,6 +1220,121 @@ TEST_CASE("Copy") {
     cout << "bt1: " << bt1;
 }
 
+TEST_CASE_TEMPLATE("Storage policies", S, storage::shared, storage::arena, storage::indexed,
+                   storage::prefetched<storage::shared>, storage::prefetched<storage::indexed>) {
+    BinaryTree<int, S> bt;
+    bt.add_root(1).add_left(1, 9).add_left(9, 4).add_right(9, 5).add_right(1, 3).add_left(1, 2);
+    vector<int> pre, in, post;
+    for (auto it = bt.begin_preorder(); it != bt.end_preorder(); ++it) {
+        pre.push_back(*it);
+    }
+    for (int i : bt) {
+        in.push_back(i);
+    }
+    for (auto it = bt.begin_postorder(); it != bt.end_postorder(); ++it) {
+        post.push_back(*it);
+    }
+    CHECK_EQ(pre, vector<int>{1, 2, 4, 5, 3});
+    CHECK_EQ(in, vector<int>{4, 2, 5, 1, 3});
+    CHECK_EQ(post, vector<int>{4, 5, 2, 3, 1});
+    CHECK_THROWS(bt.add_left(9, 7));
+
+    BinaryTree<int, S> copy{bt};
+    copy.add_root(10);
+    CHECK_EQ(*bt.begin_preorder(), 1);
+    CHECK_EQ(*copy.begin_preorder(), 10);
+    BinaryTree<int, S> moved{std::move(copy)};
+    CHECK_EQ(*moved.begin_preorder(), 10);
+    CHECK(copy.begin() == copy.end());
+
+    BinaryTree<string, S> strings;
+    strings.add_root("1");
+    for (int i = 1; i < 1000; ++i) {
+        strings.add_left(to_string(i), to_string(i + 1));
+    }
+    BinaryTree<string, S> other;
+    other = strings;
+    CHECK_EQ(*other.begin(), "1000");
+    CHECK_EQ(*other.begin_postorder(), "1000");
+}
+
+TEST_CASE_TEMPLATE("Hashed lookup", S, storage::shared, storage::arena, storage::indexed) {
+    SUBCASE("first match in preorder") {
+        BinaryTree<int, S, lookup::hashed> bt;
+        bt.add_root(1).add_left(1, 2).add_right(1, 2).add_left(2, 5);
+        CHECK_EQ(*bt.begin_postorder(), 5);
+        bt.add_left(1, 3).add_left(2, 7);  // the left 2 is gone, the right one is next
+        vector<int> pre;
+        for (auto it = bt.begin_preorder(); it != bt.end_preorder(); ++it) {
+            pre.push_back(*it);
+        }
+        CHECK_EQ(pre, vector<int>{1, 3, 5, 2, 7});
+        CHECK_THROWS(bt.add_right(9, 1));
+        bt.add_root(9).add_right(9, 1);  // no 2 is left
+        CHECK_THROWS(bt.add_left(2, 4));
+        CHECK_NOTHROW(bt.add_left(1, 4));
+    }
+    SUBCASE("values written through iterators and handles") {
+        auto bt = sample_tree<BinaryTree<int, S, lookup::hashed>>();
+        bt.reserve(16);  // keeps the iterator below valid with every storage
+        auto it = bt.begin_preorder();
+        bt.add_left(2, 3);  // over the 4
+        while (*it != 5) {
+            ++it;
+        }
+        *it = 13;  // after a lookup, through a live iterator
+        bt.add_left(13, 12);
+        CHECK_THROWS(bt.add_left(5, 7));
+        *bt.begin_preorder() = 13;  // now the root comes first in preorder
+        bt.add_right(13, 30);
+        vector<int> pre;
+        for (auto i = bt.cbegin_preorder(); i != bt.cend_preorder(); ++i) {
+            pre.push_back(*i);
+        }
+        CHECK_EQ(pre, vector<int>{13, 2, 3, 13, 12, 6, 30});
+
+        bt.reindex();  // the table again
+        bt.add_left(13, 1).add_left(12, 11);
+        CHECK_THROWS(bt.add_left(5, 7));
+        pre.clear();
+        for (auto i = bt.cbegin_preorder(); i != bt.cend_preorder(); ++i) {
+            pre.push_back(*i);
+        }
+        CHECK_EQ(pre, vector<int>{13, 1, 3, 13, 12, 11, 6, 30});
+    }
+    SUBCASE("same tree as scan") {
+        for (int k = 0; k < 20; ++k) {
+            BinaryTree<int, S> scanned;
+            BinaryTree<int, S, lookup::hashed> hashed;
+            scanned.add_root(0);
+            hashed.add_root(0);
+            for (int i = 0; i < 300; ++i) {
+                int existing = rand() % 40;
+                int value = rand() % 40;
+                bool left = rand() % 2 == 0;
+                bool threw = false;
+                try {
+                    left ? scanned.add_left(existing, value) : scanned.add_right(existing, value);
+                } catch (exception &e) {
+                    threw = true;
+                }
+                if (threw) {
+                    CHECK_THROWS(left ? hashed.add_left(existing, value) : hashed.add_right(existing, value));
+                } else {
+                    CHECK_NOTHROW(left ? hashed.add_left(existing, value) : hashed.add_right(existing, value));
+                }
+            }
+            BinaryTree<int, S, lookup::hashed> copy{hashed};
+            auto j = copy.begin_preorder();
+            for (auto i = scanned.begin_preorder(); i != scanned.end_preorder(); ++i, ++j) {
+                REQUIRE(j != copy.end_preorder());
+                CHECK_EQ(*i, *j);
+            }
+            CHECK(j == copy.end_preorder());
+        }
+    }
+}
+
 void preorder(size_t index, vector<int> &tree, vector<int> &pre) {
     if (index >= 0 && index < tree.size()) {
         pre.push_back(tree[index]);
@@ -296,4 +1357,15 @@ void postorder(size_t index, vector<int> &tree, vector<int> &post) {
         postorder(index * 2 + 2, tree, post);
         post.push_back(tree[index]);
     }
-}
\ No newline at end of file
+}
+
+template<class Tree>
+Tree sample_tree(int right) {
+    Tree bt;
+    auto root = bt.insert_root(1);
+    auto two = bt.insert_left(root, 2);
+    bt.insert_right(root, right);
+    bt.insert_left(two, 4);
+    bt.insert_right(bt.insert_right(two, 5), 6);
+    return bt;
+}
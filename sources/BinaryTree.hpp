@@ -4,173 +4,668 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <exception>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <ostream>
+#include <ranges>
+#include <span>
+#include <sstream>
 #include <stack>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "FlatView.hpp"
+#include "Generator.hpp"
+#include "NodeCache.hpp"
+#include "NodeLayout.hpp"
+#include "NodeLookup.hpp"
+#include "NodeStorage.hpp"
+#include "RingQueue.hpp"
+#include "ValueCodec.hpp"
+
 namespace ariel {
 
-    template<typename T>
+    /**
+     * Traversal orders of a BinaryTree.
+     */
+    enum class Order { pre, in, post };
+
+    /**
+     * How much of a tree BinaryTree::print shows: nodes deeper than
+     * max_depth (the root is at depth 0) and nodes after the first
+     * max_nodes printed are left out.
+     */
+    struct PrintLimits {
+        size_t max_depth = std::numeric_limits<size_t>::max();
+        size_t max_nodes = std::numeric_limits<size_t>::max();
+    };
+
+    template<typename T, typename Storage = storage::shared, typename Lookup = lookup::scan,
+            typename Layout = layout::plain, typename Cache = cache::none>
     class BinaryTree {
     private:
         struct Node {
-            T value;
-            std::shared_ptr<Node> right, left;
+            using link = typename Storage::template link<Node>;
+            using ref = typename Storage::template ref<Node>;
 
-            Node(const T &value) : value(value), right(nullptr), left(nullptr) {}
+            T value;
+            link right{}, left{};
+            [[no_unique_address]] typename Layout::template parent<ref> parent{};
+            [[no_unique_address]] typename Layout::size_field count{};  // nodes in the subtree
 
-            Node(const Node &other) : value(other.value) {
-                if (other.left != nullptr) {
-                    std::shared_ptr<Node> tmp{new Node(*other.left)};
-                    left = tmp;
-                } else {
-                    left = nullptr;
+            Node(const T &value) : value(value) {
+                if constexpr (Layout::has_size) {
+                    count = 1;
                 }
-                if (other.right != nullptr) {
-                    std::shared_ptr<Node> tmp{new Node(*other.right)};
-                    right = tmp;
-                } else {
-                    right = nullptr;
+            }
+        };  // END Node class
+
+        using link = typename Node::link;
+        using pool = typename Storage::template pool<Node>;
+
+        pool nodes;
+        typename Lookup::template table<T, typename pool::ref> values;
+        link root{};
+        uint size;
+        typename Cache::template store<T *> orders;  // traversal orders, if cached
+        // the width of the widest value, for operator<<. Kept up as values are
+        // added; unknown_width once the widest one is overwritten, and for as
+        // long as values may be written through an iterator or a handle -
+        // print measures then.
+        mutable std::atomic<size_t> width{0};
+        static constexpr size_t unknown_width = std::numeric_limits<size_t>::max();
+        // references to the values were handed out, so they may be written
+        // behind the lookup table's back - lookups search until reindex().
+        mutable std::atomic<bool> values_exposed{false};
+
+        // the head of serialize's format
+        static constexpr char serial_magic[4] = {'B', 'T', 'R', 'E'};
+        static constexpr std::uint8_t serial_version = 1;
+        static constexpr size_t serial_reserve = size_t{1} << 16;  // nodes deserialize makes room for up front
+
+        Node *root_node() const { return nodes.get(root); }
+
+        Node *at_node(typename pool::ref r) const {
+            Node *n = nodes.get(r);
+            if (n == nullptr) {
+                throw std::runtime_error("Error: empty handle.\n");
+            }
+            return n;
+        }
+
+        /**
+         * Record n as the parent of child, if the layout keeps parents.
+         */
+        void adopt(Node *n, Node *child) {
+            if constexpr (Layout::has_parent) {
+                child->parent = nodes.ref_of(n);
+            }
+        }
+
+        /**
+         * Count a new node in the subtree sizes of n and its ancestors, if the
+         * layout keeps sizes.
+         */
+        void count_up(Node *n) {
+            if constexpr (Layout::has_size) {
+                for (; n != nullptr; n = nodes.get(n->parent)) {
+                    ++n->count;
                 }
             }
+        }
 
-            Node &operator=(const Node &other) {
-                if (this == &other) {
-                    return *this;
+        /**
+         * Deep copy the nodes of other into this (empty) tree.
+         */
+        void copy_from(const BinaryTree &other) {
+            const Node *src = other.root_node();
+            if (src == nullptr) {
+                return;
+            }
+            nodes.reserve(other.size);
+            root = nodes.make(src->value);
+            root_node()->count = src->count;
+            values.added(src->value, root_node(), nodes);
+            std::stack<std::pair<const Node *, Node *>> todo;
+            todo.emplace(src, root_node());
+            while (!todo.empty()) {
+                auto [from, to] = todo.top();
+                todo.pop();
+                if (const Node *l = other.nodes.get(from->left)) {
+                    to->left = nodes.make(l->value);
+                    adopt(to, nodes.get(to->left));
+                    nodes.get(to->left)->count = l->count;
+                    values.added(l->value, nodes.get(to->left), nodes);
+                    todo.emplace(l, nodes.get(to->left));
                 }
-                value = other.value;
-                if (other.left != nullptr) {
-                    left = new Node(*other.left);
-                } else {
-                    left = nullptr;
+                if (const Node *r = other.nodes.get(from->right)) {
+                    to->right = nodes.make(r->value);
+                    adopt(to, nodes.get(to->right));
+                    nodes.get(to->right)->count = r->count;
+                    values.added(r->value, nodes.get(to->right), nodes);
+                    todo.emplace(r, nodes.get(to->right));
+                }
+            }
+        }
+
+        /**
+         * Search the value in the tree, start from n node.
+         * Walks in preorder with an explicit stack and stops at the first match,
+         * so deep trees don't overflow the call stack.
+         * @param n node to start the search on.
+         * @param value value to search.
+         * @return Node* of the first node (in preorder) contain the value,
+         * nullptr if the value not in the tree.
+         */
+        Node *search(Node *n, const T &value) const {
+            std::vector<Node *> stack;
+            while (n != nullptr) {
+                if (n->value == value) {
+                    return n;
                 }
-                if (other.right != nullptr) {
-                    right = new Node(*other.right);
+                Node *l = nodes.get(n->left);
+                Node *r = nodes.get(n->right);
+                if (l != nullptr) {
+                    if (r != nullptr) {
+                        nodes.prefetch(r);  // searched after the whole left subtree
+                        stack.push_back(r);
+                    }
+                    n = l;
+                } else if (r != nullptr) {
+                    n = r;
+                } else if (!stack.empty()) {
+                    n = stack.back();
+                    stack.pop_back();
                 } else {
-                    right = nullptr;
+                    n = nullptr;
                 }
             }
+            return nullptr;
+        }
 
-            Node(Node &&other) noexcept {
-                value = other.value;
-                right = other.right;
-                other.right = nullptr;
-                left = other.left;
-                other.left = nullptr;
+        /**
+         * The first node in preorder holding value, nullptr if the value not in
+         * the tree. Answered by the lookup table when it can, by search otherwise.
+         */
+        Node *find(const T &value) {
+            if (values_exposed.load(std::memory_order_relaxed)) {
+                return search(root_node(), value);
             }
+            return values.find(value, nodes, [&] { return search(root_node(), value); });
+        }
 
-            Node &operator=(Node &&other) noexcept {
-                if (this == &other) {
-                    return *this;
-                }
-                value = other.value;
-                right = other.right;
-                other.right = nullptr;
-                left = other.left;
-                other.left = nullptr;
+        /**
+         * The number of characters value takes when streamed with the default
+         * format. Numbers are measured with std::to_chars, other types are
+         * streamed.
+         */
+        static size_t width_of(const T &value) {
+            using U = std::remove_cv_t<T>;
+            // chars and bools stream as characters and 0/1, not as numbers
+            constexpr bool number = std::is_integral_v<U> && !std::is_same_v<U, bool> && !std::is_same_v<U, char> &&
+                                    !std::is_same_v<U, signed char> && !std::is_same_v<U, unsigned char> &&
+                                    !std::is_same_v<U, wchar_t> && !std::is_same_v<U, char8_t> &&
+                                    !std::is_same_v<U, char16_t> && !std::is_same_v<U, char32_t>;
+            if constexpr (number) {
+                char buffer[std::numeric_limits<U>::digits10 + 3];
+                return static_cast<size_t>(std::to_chars(std::begin(buffer), std::end(buffer), value).ptr - buffer);
+            } else if constexpr (std::is_floating_point_v<U>) {
+                char buffer[64];  // streams print %g with precision 6
+                return static_cast<size_t>(
+                        std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::general, 6).ptr -
+                        buffer);
+            } else if constexpr (requires(std::ostream &os) { os << value; }) {
+                thread_local std::ostringstream stream;
+                stream.str("");
+                stream << value;
+                return stream.view().size();
+            } else {  // trees of values that can't be printed
+                return 0;
             }
+        }
 
-            ~Node() = default;
-        };  // END Node class
+        /**
+         * value is now in the tree - widen the known width to it.
+         */
+        void widen(const T &value) {
+            size_t w = width.load(std::memory_order_relaxed);
+            if (w != unknown_width) {
+                width.store(std::max(w, width_of(value)), std::memory_order_relaxed);
+            }
+        }
 
-        std::shared_ptr<Node> root;
-        uint size;
+        /**
+         * Values may be written through what is handed out, so the width
+         * has to be measured again and the lookup table can't be trusted.
+         */
+        void exposed() const {
+            width.store(unknown_width, std::memory_order_relaxed);
+            values_exposed.store(true, std::memory_order_relaxed);
+        }
 
         /**
-         * Search the value in the tree, start from n node.
-         * @param n node to start the search on.
-         * @param value value to search.
-         * @return Node* of the node contain the value, nullptr if the value not in
-         * the tree.
+         * Overwrite the value of an existing node.
          */
-        std::shared_ptr<Node> search(std::shared_ptr<Node> n, T value) {
-            if (n == nullptr) {
-                return nullptr;
+        void assign(Node *n, const T &value) {
+            size_t w = width.load(std::memory_order_relaxed);
+            if (w != unknown_width && width_of(n->value) == w) {
+                width.store(unknown_width, std::memory_order_relaxed);  // maybe the only value that wide
             }
-            if (n->value == value) {
-                return n;
+            values.removed(n->value, n, nodes);
+            n->value = value;
+            values.added(n->value, n, nodes);
+            widen(n->value);
+        }
+
+        /**
+         * Make room in the storage for n more nodes. The cached orders point
+         * into the nodes, so they go when the nodes move - even if no node
+         * gets created after all.
+         */
+        void make_room(size_t n) {
+            if (nodes.reserve(n)) {
+                orders.invalidate();
             }
-            std::shared_ptr<Node> l = search(n->left, value);
-            std::shared_ptr<Node> r = search(n->right, value);
-            if (l == nullptr) {
-                return r;
+        }
+
+        /**
+         * Put value in the child of n on the given side, creating the child if
+         * there is none. The storage must have room for one more node.
+         * @return the child.
+         */
+        Node *set_child(Node *n, link Node::*side, const T &value) {
+            if (nodes.get(n->*side) == nullptr) {
+                n->*side = nodes.make(value);
+                adopt(n, nodes.get(n->*side));
+                count_up(n);
+                values.added(value, nodes.get(n->*side), nodes);
+                orders.invalidate();
+                widen(value);
+                ++size;
+            } else {
+                assign(nodes.get(n->*side), value);
             }
-            return l;
+            return nodes.get(n->*side);
         }
 
-        // Base on:
-        // https://stackoverflow.com/questions/36802354/print-binary-tree-in-a-pretty-way-using-c
-        static void print(const std::string &prefix,
-                          const std::shared_ptr<Node> node, bool isRight,
-                          std::ostream &os, size_t spaces) {
-            if (node == nullptr) {
-                return;
+        /**
+         * Morris traversal: walks the tree without a stack by threading the
+         * rightmost node of each left subtree to its successor, and removing
+         * the thread on the way back. Every thread is removed by the end of
+         * the walk, also when visit throws - the walk then completes without
+         * visiting and the exception is rethrown.
+         * @param preorder visit in preorder if true, in inorder otherwise.
+         */
+        template<typename Visitor>
+        void morris(Visitor &visit, bool preorder) {
+            exposed();
+            std::exception_ptr error;
+            auto call = [&](Node *n) {
+                if (error) {
+                    return;
+                }
+                try {
+                    visit(n->value);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            };
+
+            link cur = root;
+            while (Node *n = nodes.get(cur)) {
+                Node *pred = nodes.get(n->left);
+                if (pred == nullptr) {
+                    call(n);
+                    cur = n->right;
+                    continue;
+                }
+                while (nodes.get(pred->right) != nullptr && nodes.get(pred->right) != n) {
+                    pred = nodes.get(pred->right);
+                }
+                if (nodes.get(pred->right) == nullptr) {  // first visit - thread back to n
+                    if (preorder) {
+                        call(n);
+                    }
+                    pred->right = cur;
+                    cur = n->left;
+                } else {  // left subtree done - remove the thread
+                    pred->right = link{};
+                    if (!preorder) {
+                        call(n);
+                    }
+                    cur = n->right;
+                }
             }
-            std::string spaces_str(spaces - 1, ' ');
-            os << prefix << spaces_str;
-            if (isRight) {
-                os << "╙──";
-            } else {
-                os << "╠──";
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        /**
+         * Walks n's subtree in order O with an explicit stack, one node per
+         * next() - nullptr at the end. Unlike the iterators it stays inside
+         * the subtree with every layout.
+         */
+        template<Order O>
+        class Walker {
+        private:
+            std::vector<std::pair<Node *, bool>> stack;  // bool: children already pushed
+            const pool *nodes;
+
+        public:
+            Walker(Node *n, const pool *nodes) : nodes(nodes) {
+                if (n != nullptr) {
+                    stack.emplace_back(n, false);
+                }
             }
 
-            // print the value of the node
-            os << std::setw((int) spaces) << node->value;
-            if (node->left || node->right) {
-                os << "╖";
+            Node *next() {
+                while (!stack.empty()) {
+                    auto [top, expanded] = stack.back();
+                    stack.pop_back();
+                    if (expanded) {
+                        return top;
+                    }
+                    Node *l = nodes->get(top->left);
+                    Node *r = nodes->get(top->right);
+                    if constexpr (O == Order::pre) {
+                        if (r != nullptr) {
+                            stack.emplace_back(r, false);
+                        }
+                        if (l != nullptr) {
+                            stack.emplace_back(l, false);
+                        }
+                        return top;
+                    } else if constexpr (O == Order::in) {
+                        // go down the left spine, the first node of top's subtree comes out next
+                        while (true) {
+                            if (r != nullptr) {
+                                stack.emplace_back(r, false);
+                            }
+                            if (l == nullptr) {
+                                return top;
+                            }
+                            stack.emplace_back(top, true);
+                            top = l;
+                            l = nodes->get(top->left);
+                            r = nodes->get(top->right);
+                        }
+                    } else {
+                        stack.emplace_back(top, true);
+                        if (r != nullptr) {
+                            stack.emplace_back(r, false);
+                        }
+                        if (l != nullptr) {
+                            stack.emplace_back(l, false);
+                        }
+                    }
+                }
+                return nullptr;
             }
-            os << std::endl;
+        };  // END Walker class
 
-            // enter the next tree level - left and right branch
-            print(prefix + spaces_str + (isRight ? "    " : "║   "), node->right,
-                  false, os, spaces);
-            print(prefix + spaces_str + (isRight ? "    " : "║   "), node->left,
-                  true, os, spaces);
+        /**
+         * Call visit(node) on every node of n's subtree in order O.
+         */
+        template<Order O, typename Visit>
+        void walk(Node *n, Visit visit) const {
+            Walker<O> walker{n, &nodes};
+            while (Node *next = walker.next()) {
+                visit(next);
+            }
         }
 
-        static size_t calc_len(const std::shared_ptr<Node> n, size_t ans) {
-            if (n == nullptr) {
-                return 0;
+        /**
+         * Euler tour: one walk that enters each node, comes back to it
+         * between its subtrees, and leaves it. One stack frame per level.
+         * @tparam V the value type given to the visitor, T or const T.
+         */
+        template<typename V, typename Visitor>
+        void tour(Visitor &visitor) const {
+            if constexpr (!std::is_const_v<V>) {
+                exposed();
+            }
+            // the depth of a node is its place on the stack
+            struct frame {
+                Node *node;
+                size_t first;  // nodes entered before this one
+                int step;  // 0 enter, 1 between, 2 exit
+            };
+            std::vector<frame> stack;
+            size_t entered = 0;
+            if (root_node() != nullptr) {
+                stack.push_back(frame{root_node(), 0, 0});
+            }
+            while (!stack.empty()) {
+                frame &f = stack.back();
+                Node *n = f.node;
+                size_t depth = stack.size() - 1;
+                V &value = n->value;
+                // a missing child falls through to the next step at once
+                if (f.step == 0) {
+                    f.step = 1;
+                    f.first = entered++;
+                    if constexpr (requires { visitor.on_enter(value, depth); }) {
+                        visitor.on_enter(value, depth);
+                    }
+                    if (Node *l = nodes.get(n->left)) {
+                        stack.push_back(frame{l, 0, 0});
+                        continue;
+                    }
+                }
+                if (f.step == 1) {
+                    f.step = 2;
+                    if constexpr (requires { visitor.on_between(value, depth); }) {
+                        visitor.on_between(value, depth);
+                    }
+                    if (Node *r = nodes.get(n->right)) {
+                        stack.push_back(frame{r, 0, 0});
+                        continue;
+                    }
+                }
+                size_t subtree = entered - f.first;
+                stack.pop_back();
+                if constexpr (requires { visitor.on_exit(value, depth, subtree); }) {
+                    visitor.on_exit(value, depth, subtree);
+                } else if constexpr (requires { visitor.on_exit(value, depth); }) {
+                    visitor.on_exit(value, depth);
+                }
             }
-            std::stringstream stream;
-            stream << n->value;
-            ans = stream.str().size();
-            size_t left_ans = calc_len(n->left, ans);
-            size_t right_ans = calc_len(n->right, ans);
-            if (left_ans > ans) {
-                ans = left_ans;
+        }
+
+#ifdef ARIEL_HAS_GENERATOR
+        template<Order O, typename R>
+        Generator<R> generate() const {
+            if constexpr (!std::is_const_v<std::remove_reference_t<R>>) {
+                exposed();
+            }
+            Walker<O> walker{root_node(), &nodes};
+            while (Node *n = walker.next()) {
+                co_yield n->value;
+            }
+        }
+#endif
+
+        /**
+         * Pointers to the values of n's subtree, in the given order.
+         */
+        template<typename V>
+        std::vector<V *> flat(Node *n, Order order) const {
+            std::vector<V *> items;
+            items.reserve(n == root_node() ? size : 0);
+            auto push = [&items](Node *node) { items.push_back(&node->value); };
+            switch (order) {
+                case Order::pre:
+                    walk<Order::pre>(n, push);
+                    break;
+                case Order::in:
+                    walk<Order::in>(n, push);
+                    break;
+                case Order::post:
+                    walk<Order::post>(n, push);
+                    break;
+            }
+            return items;
+        }
+
+        /**
+         * The lines of the printed tree, top to bottom, within limits: calls
+         * line(node, isRight, elided, prefix_len) for each, and line returns
+         * the prefix length of the node's children. An elided line stands
+         * for the whole subtree of node, which is never walked.
+         */
+        template<typename Line>
+        void print_lines(const PrintLimits &limits, Line line) const {
+            struct frame {
+                const Node *node;
+                bool isRight;
+                bool elided;
+                size_t depth;
+                size_t prefix_len;
+            };
+            std::vector<frame> stack;
+            if (root_node() != nullptr) {
+                stack.push_back(frame{root_node(), true, false, 0, 0});
+            }
+            size_t printed = 0;
+            while (!stack.empty()) {
+                frame f = stack.back();
+                stack.pop_back();
+                bool elided = f.elided || printed >= limits.max_nodes;
+                size_t prefix_len = line(f.node, f.isRight, elided, f.prefix_len);
+                if (elided) {
+                    continue;
+                }
+                ++printed;
+
+                // enter the next tree level - right branch on top, so pushed last
+                bool cut = f.depth >= limits.max_depth;
+                if (const Node *l = nodes.get(f.node->left)) {
+                    stack.push_back(frame{l, true, cut, f.depth + 1, prefix_len});
+                }
+                if (const Node *r = nodes.get(f.node->right)) {
+                    stack.push_back(frame{r, false, cut, f.depth + 1, prefix_len});
+                }
+            }
+        }
+
+        // Base on:
+        // https://stackoverflow.com/questions/36802354/print-binary-tree-in-a-pretty-way-using-c
+        // Keeps one prefix buffer: a node appends its segment to the buffer
+        // and its children cut it back to there. Lines are collected and
+        // handed to sink(std::string_view) in large blocks; cell(out, value,
+        // width) appends a value right aligned in width characters.
+        template<typename Sink, typename Cell>
+        void draw(Sink &sink, Cell &cell, size_t spaces, const PrintLimits &limits) const {
+            const size_t block = size_t{1} << 16;
+            const std::string spaces_str(spaces - 1, ' ');
+            std::string prefix;
+            std::string out = "BinaryTree: (size = ";
+            append_grouped(out, size, false);
+            out += ")\n";
+            out += spaces_str;
+            out += "╗\n";
+            print_lines(limits, [&](const Node *node, bool isRight, bool elided, size_t prefix_len) {
+                prefix.resize(prefix_len);
+                out += prefix;
+                out += spaces_str;
+                out += isRight ? "╙──" : "╠──";
+                if (elided) {
+                    out += "...";
+                    if constexpr (Layout::has_size) {
+                        out += " (";
+                        append_grouped(out, node->count);
+                        out += node->count == 1 ? " node)" : " nodes)";
+                    }
+                } else {
+                    // print the value of the node
+                    cell(out, node->value, spaces);
+                    if (nodes.get(node->left) != nullptr || nodes.get(node->right) != nullptr) {
+                        out += "╖";
+                    }
+                }
+                out += '\n';
+                if (out.size() >= block) {
+                    sink(std::string_view(out));
+                    out.clear();
+                }
+                prefix += spaces_str;
+                prefix += isRight ? "    " : "║   ";
+                return prefix.size();
+            });
+            sink(std::string_view(out));
+        }
+
+        // n, by default with a comma between groups of thousands: 12,345
+        static void append_grouped(std::string &out, size_t n, bool commas = true) {
+            char digits[std::numeric_limits<size_t>::digits10 + 1];
+            auto end = std::to_chars(std::begin(digits), std::end(digits), n).ptr;
+            auto count = end - digits;
+            for (auto i = 0; i < count; ++i) {
+                if (commas && i > 0 && (count - i) % 3 == 0) {
+                    out += ',';
+                }
+                out += digits[i];
             }
-            if (right_ans > ans) {
-                ans = right_ans;
+        }
+
+        // the width of the widest value, 0 for an empty tree - measured when
+        // unknown, and kept unless values may still be written behind the
+        // tree's back
+        size_t calc_len() const {
+            size_t ans = width.load(std::memory_order_relaxed);
+            if (ans == unknown_width) {
+                ans = 0;
+                walk<Order::pre>(root_node(), [&ans](const Node *n) { ans = std::max(ans, width_of(n->value)); });
+                if (!values_exposed.load(std::memory_order_relaxed)) {
+                    width.store(ans, std::memory_order_relaxed);
+                }
             }
             return ans;
         }
 
     public:
-        BinaryTree() : root(nullptr), size(0) {}
+        BinaryTree() : size(0) {}
 
-        BinaryTree(const BinaryTree &other) : size(other.size) {
-            std::shared_ptr<Node> tmp{new Node(*other.root)};
-            root = tmp;
+        BinaryTree(const BinaryTree &other) : size(other.size), width(other.width.load(std::memory_order_relaxed)) {
+            copy_from(other);
         }
 
-        BinaryTree(BinaryTree &&other) noexcept {
-            size = other.size;
-            root = other.root;
-            other.root = nullptr;
+        BinaryTree(BinaryTree &&other) noexcept
+                : nodes(std::move(other.nodes)), values(std::move(other.values)), root(std::exchange(other.root, link{})), size(other.size),
+                  width(other.width.exchange(0, std::memory_order_relaxed)),
+                  values_exposed(other.values_exposed.exchange(false, std::memory_order_relaxed)) {
+            other.orders.invalidate();
+            other.size = 0;
         }
 
-        ~BinaryTree() = default;
+        ~BinaryTree() { nodes.release(root); }
 
         BinaryTree &operator=(const BinaryTree &other) {
             if (this == &other) {
                 return *this;
             }
-            root = std::make_shared<Node>(*other.root);
+            nodes.release(root);
+            values.clear();
+            orders.invalidate();
+            width.store(other.width.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            values_exposed.store(false, std::memory_order_relaxed);  // copy_from fills the table afresh
+            size = other.size;
+            copy_from(other);
             return *this;
         }
 
@@ -178,218 +673,1227 @@ namespace ariel {
             if (this == &other) {
                 return *this;
             }
+            nodes.release(root);
+            root = std::exchange(other.root, link{});
+            nodes = std::move(other.nodes);
+            values = std::move(other.values);
+            orders.invalidate();
+            other.orders.invalidate();
+            width.store(other.width.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+            values_exposed.store(other.values_exposed.exchange(false, std::memory_order_relaxed), std::memory_order_relaxed);
             size = other.size;
-            root = other.root;
-            other.root = nullptr;
+            other.size = 0;
             return *this;
         }
 
+        /**
+         * Prepare room for n more nodes. Only a hint: the arena storage
+         * allocates a chunk of at least n nodes, the indexed storage grows its
+         * vector, the shared storage ignores it.
+         */
+        void reserve(size_t n) { make_room(n); }
+
+        /**
+         * Once the tree has handed out references to its values - mutable
+         * iterators, cursors, at(Handle), flatten, generators, euler_tour,
+         * parallel_for_each - writes through them can't be seen, so lookups
+         * search the tree like lookup::scan does, and print measures the
+         * values every time. Call reindex() when those writes are done, to
+         * rebuild the lookup table and measure the width once more.
+         */
+        void reindex() {
+            values_exposed.store(false, std::memory_order_relaxed);
+            values.rebuild(nodes, [&](auto add) { walk<Order::pre>(root_node(), add); });
+            width.store(unknown_width, std::memory_order_relaxed);
+            calc_len();
+        }
+
         BinaryTree &add_root(T value) {
-            if (root == nullptr) {
-                std::shared_ptr<Node> tmp{new Node{value}};
-                root = tmp;
+            if (root_node() == nullptr) {
+                root = nodes.make(value);
+                values.added(value, root_node(), nodes);
+                orders.invalidate();
+                widen(value);
                 ++size;
             } else {
-                root->value = value;
+                assign(root_node(), value);
             }
             return *this;
         }
 
         BinaryTree &add_left(T existing_value, T new_value) {
-            std::shared_ptr<Node> n = search(root, existing_value);
+            make_room(1);  // n must survive the make() below
+            Node *n = find(existing_value);
             if (n == nullptr) {
                 throw std::runtime_error(
                         "Error: existing_value is no exist in the tree.\n");
             }
-            if (n->left == nullptr) {
-                std::shared_ptr<Node> tmp{new Node{new_value}};
-                n->left = tmp;
-                ++size;
-            } else {
-                n->left->value = new_value;
-            }
+            set_child(n, &Node::left, new_value);
             return *this;
         }
 
         BinaryTree &add_right(T existing_value, T new_value) {
-            std::shared_ptr<Node> n = search(root, existing_value);
+            make_room(1);  // n must survive the make() below
+            Node *n = find(existing_value);
             if (n == nullptr) {
                 throw std::runtime_error(
                         "Error: existing_value is no exist in the tree.\n");
             }
-            if (n->right == nullptr) {
-                std::shared_ptr<Node> tmp{new Node{new_value}};
-                n->right = tmp;
-                ++size;
-            } else {
-                n->right->value = new_value;
-            }
+            set_child(n, &Node::right, new_value);
             return *this;
         }
 
-        friend std::ostream &operator<<(std::ostream &os, const BinaryTree<T> &tree) {
-            os << "BinaryTree: (size = " << tree.size << ")" << std::endl;
-            size_t len = calc_len(tree.root, 0);
-            std::string spaces_str(len - 1, ' ');
-            os << spaces_str << "╗" << std::endl;
-            print("", tree.root, true, os, len);
-            return os;
-        }
-
-        struct Iterator {
+        /**
+         * Lightweight reference to a node, returned by the insert_* methods so
+         * builders can attach children without looking the parent up by value.
+         * Stays valid while the tree grows; it refers to this tree only, copies
+         * of the tree don't carry it over.
+         */
+        class Handle {
         private:
-            std::shared_ptr<Node> curr;
-            std::shared_ptr<Node> root;
-            int type;  // -1: pre | 0: in | 1: post
-            std::stack<std::shared_ptr<Node>> stack;
-            std::shared_ptr<Node> prev;
-
-            void insert_left(std::shared_ptr<Node> &n) {
-                while (n != nullptr) {
-                    stack.push(n);
-                    n = n->left;
-                }
-            }
+            using ref = typename pool::ref;
+            ref node{};
 
-            void pre_plus() {
-                if (!stack.empty()) {
-                    curr = stack.top();
-                    stack.pop();
-                    if (curr->right) {
-                        stack.push(curr->right);
-                    }
-                    if (curr->left) {
-                        stack.push(curr->left);
-                    }
-                } else {
-                    curr = nullptr;
-                }
-            }
+            explicit Handle(ref node) : node(node) {}
 
-            // Base on:
-            // https://www.geeksforgeeks.org/inorder-tree-traversal-without-recursion/
-            void in_plus() {
-                if (!stack.empty()) {
-                    curr = stack.top();
-                    stack.pop();
-                    auto tmp = curr->right;
-                    insert_left(tmp);
-                } else {
-                    curr = nullptr;
-                }
-            }
+            friend class BinaryTree;
 
-            // Base on:
-            // https://www.geeksforgeeks.org/iterative-postorder-traversal-using-stack/
-            void post_plus() {
-                while (!stack.empty()) {
-                    std::shared_ptr<Node> current = stack.top();
+        public:
+            Handle() = default;
 
-                    // go down the tree in search of a leaf an if so process it and pop stack otherwise move down
-                    if (prev.get() == nullptr || prev->left == current ||
-                        prev->right == current) {
-                        if (current->left != nullptr) {
-                            stack.push(current->left);
-                        } else if (current->right != nullptr) {
-                            stack.push(current->right);
-                        } else {
-                            stack.pop();
-                            curr = current;
-                            prev = current;
-                            return;
-                        }
-                        // go up the tree from left node, if the child is right
-                        // push it onto stack otherwise process parent and pop stack
-                    } else if (current->left == prev) {
-                        if (current->right != nullptr) {
-                            stack.push(current->right);
-                        } else {
-                            stack.pop();
-                            curr = current;
-                            prev = current;
-                            return;
-                        }
-                        // go up the tree from right node and after coming back
-                        // from right node process parent and pop stack
-                    } else if (current->right == prev) {
-                        stack.pop();
-                        curr = current;
-                        prev = current;
-                        return;
-                    }
-                    prev = current;
-                }
-                curr = nullptr;
-            }
+            explicit operator bool() const { return !(node == ref{}); }
 
-        public:
-            Iterator(std::shared_ptr<Node> n, int flag) : curr(n), type(flag), prev(nullptr) {
-                if (n == nullptr) {
-                    return;
-                }
-                root = n;  // post helper
+            bool operator==(const Handle &rhs) const { return node == rhs.node; }
 
-                if (type == -1) {  // pre
-                    if (curr->right) {
-                        stack.push(curr->right);
-                    }
-                    if (curr->left) {
-                        stack.push(curr->left);
-                    }
+            bool operator!=(const Handle &rhs) const { return !(node == rhs.node); }
+        };  // END Handle class
 
-                } else if (type == 0) {  // in
-                    insert_left(n);
-                    in_plus();
+        /**
+         * Like add_root.
+         * @return handle to the root.
+         */
+        Handle insert_root(const T &value) {
+            add_root(value);
+            return Handle{nodes.ref_of(root_node())};
+        }
 
-                } else {  // post
-                    if (curr == nullptr) {
-                        return;
-                    }
-                    stack.push(curr);
-                    post_plus();
-                }
-            }
+        /**
+         * Like add_left, with the parent given by handle instead of by value.
+         * @return handle to the left child of parent.
+         */
+        Handle insert_left(Handle parent, const T &value) {
+            make_room(1);
+            return Handle{nodes.ref_of(set_child(at_node(parent.node), &Node::left, value))};
+        }
 
-            T &operator*() const { return curr->value; }
+        /**
+         * Like add_right, with the parent given by handle instead of by value.
+         * @return handle to the right child of parent.
+         */
+        Handle insert_right(Handle parent, const T &value) {
+            make_room(1);
+            return Handle{nodes.ref_of(set_child(at_node(parent.node), &Node::right, value))};
+        }
 
-            T *operator->() const { return &(curr->value); }
+        /**
+         * @return handle to the first node (in preorder) holding value, an
+         * empty handle if the value not in the tree.
+         */
+        Handle handle_of(const T &value) {
+            Node *n = find(value);
+            return n == nullptr ? Handle{} : Handle{nodes.ref_of(n)};
+        }
 
-            Iterator &operator++() {
-                if (type == -1) {
-                    pre_plus();
-                } else if (type == 0) {
+        /**
+         * The value of the node behind handle.
+         */
+        T &at(Handle h) {
+            exposed();
+            return at_node(h.node)->value;
+        }
+
+        const T &at(Handle h) const { return at_node(h.node)->value; }
+
+        /**
+         * Call visit(value) on every value in inorder, with O(1) extra memory
+         * and no allocation (Morris traversal). The tree is modified while
+         * walking and restored at the end, so visit must not change the tree
+         * and no one else may read it meanwhile.
+         */
+        template<typename Visitor>
+        void morris_inorder(Visitor visit) { morris(visit, false); }
+
+        /**
+         * Like morris_inorder, in preorder.
+         */
+        template<typename Visitor>
+        void morris_preorder(Visitor visit) { morris(visit, true); }
+
+        /**
+         * Walk the tree once and tell visitor about every node three times:
+         *   on_enter(value, depth)          before its subtrees - preorder,
+         *   on_between(value, depth)        between them - inorder,
+         *   on_exit(value, depth[, size])   after them - postorder, with
+         *                                   the size of its subtree if
+         *                                   on_exit takes one.
+         * The root is at depth 0. Callbacks the visitor doesn't have are
+         * skipped. The visitor must not change the shape of the tree.
+         */
+        template<typename Visitor>
+        void euler_tour(Visitor &&visitor) { tour<T>(visitor); }
+
+        template<typename Visitor>
+        void euler_tour(Visitor &&visitor) const { tour<const T>(visitor); }
+
+        /**
+         * Random access view of the values in the given order, for the
+         * standard algorithms - including the parallel ones:
+         *   auto view = tree.flatten(Order::pre);
+         *   std::for_each(std::execution::par, view.begin(), view.end(), f);
+         * Takes one walk and a pointer per node. The view writes through to
+         * the tree and goes stale once nodes are added.
+         */
+        FlatView<T> flatten(Order order) {
+            exposed();
+            return FlatView<T>{flat<T>(root_node(), order)};
+        }
+
+        FlatView<const T> flatten(Order order) const { return FlatView<const T>{flat<const T>(root_node(), order)}; }
+
+        /**
+         * Like flatten(order), over the subtree of the node behind handle.
+         */
+        FlatView<T> flatten(Order order, Handle subtree) {
+            exposed();
+            return FlatView<T>{flat<T>(at_node(subtree.node), order)};
+        }
+
+        FlatView<const T> flatten(Order order, Handle subtree) const {
+            return FlatView<const T>{flat<const T>(at_node(subtree.node), order)};
+        }
+
+#ifdef ARIEL_HAS_GENERATOR
+        /**
+         * Lazy traversals as coroutine generators - input ranges that work
+         * with range-for and std::views:
+         *   for (int v : tree.inorder() | std::views::filter(odd)) ...
+         * Each generator keeps one coroutine frame with its stack and
+         * allocates nothing per value. The tree must outlive the generator
+         * and not change while it runs.
+         */
+        Generator<T &> preorder() { return generate<Order::pre, T &>(); }
+        Generator<T &> inorder() { return generate<Order::in, T &>(); }
+        Generator<T &> postorder() { return generate<Order::post, T &>(); }
+        Generator<const T &> preorder() const { return generate<Order::pre, const T &>(); }
+        Generator<const T &> inorder() const { return generate<Order::in, const T &>(); }
+        Generator<const T &> postorder() const { return generate<Order::post, const T &>(); }
+#endif
+
+        /**
+         * Write the tree to os in a compact binary form, read back by
+         * deserialize:
+         *   "BTRE", format version (1 byte), number of nodes (8 bytes),
+         *   the nodes in preorder, in groups of four:
+         *     a tag byte, 2 bits a node from the low bits - has a left
+         *     child, has a right child,
+         *     the four values, by codec::value<T> - trivially copyable
+         *     values as their bytes, strings as length and characters.
+         * One walk over the tree.
+         */
+        void serialize(std::ostream &os) const {
+            codec::Writer out(os);
+            out.put(serial_magic, sizeof(serial_magic));
+            out.number(serial_version);
+            out.number(static_cast<std::uint64_t>(size));
+            size_t i = 0;
+            unsigned tags = 0;
+            walk<Order::pre>(root_node(), [&](const Node *n) {
+                if (i % 4 == 0) {
+                    out.hold();
+                }
+                unsigned tag = (nodes.get(n->left) != nullptr ? 1U : 0U) | (nodes.get(n->right) != nullptr ? 2U : 0U);
+                tags |= tag << (2 * (i % 4));
+                codec::value<T>::write(out, n->value);
+                if (++i % 4 == 0) {
+                    out.fill(static_cast<std::uint8_t>(tags));
+                    tags = 0;
+                }
+            });
+            if (i % 4 != 0) {
+                out.fill(static_cast<std::uint8_t>(tags));
+            }
+            out.flush();
+        }
+
+        /**
+         * Replace the tree with one written by serialize. One pass over the
+         * nodes, with no value lookups. Throws if the data is not a tree; the
+         * tree is then left as it was.
+         */
+        BinaryTree &deserialize(std::istream &is) {
+            codec::Reader in(is);
+            char magic[sizeof(serial_magic)];
+            in.get(magic, sizeof(magic));
+            if (!std::equal(std::begin(magic), std::end(magic), std::begin(serial_magic)) ||
+                in.number<std::uint8_t>() != serial_version) {
+                throw std::runtime_error("Error: not a serialized tree.\n");
+            }
+            auto count = in.number<std::uint64_t>();
+            if (count > std::numeric_limits<uint>::max()) {
+                throw std::runtime_error("Error: the serialized tree is too large.\n");
+            }
+
+            BinaryTree tree;
+            // the count is not trusted yet - past the first nodes the pool grows as they are read
+            tree.nodes.reserve(std::min(static_cast<size_t>(count), serial_reserve));
+            // children still to read, the next one on top
+            std::vector<std::pair<typename pool::ref, link Node::*>> slots;
+            unsigned tags = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (i % 4 == 0) {
+                    tags = in.number<std::uint8_t>();
+                }
+                T value = codec::value<T>::read(in);
+                Node *n;
+                if (i == 0) {
+                    tree.root = tree.nodes.make(value);
+                    n = tree.root_node();
+                } else if (slots.empty()) {
+                    throw std::runtime_error("Error: the serialized tree has more values than places.\n");
+                } else {
+                    auto [parent_ref, side] = slots.back();
+                    slots.pop_back();
+                    link child = tree.nodes.make(value);
+                    Node *parent = tree.nodes.get(parent_ref);  // after make(), which may move nodes
+                    parent->*side = std::move(child);
+                    n = tree.nodes.get(parent->*side);
+                    tree.adopt(parent, n);
+                }
+                tree.values.added(n->value, n, tree.nodes);
+                tree.widen(n->value);
+                unsigned tag = (tags >> (2 * (i % 4))) & 3U;
+                if ((tag & 2U) != 0) {
+                    slots.emplace_back(tree.nodes.ref_of(n), &Node::right);
+                }
+                if ((tag & 1U) != 0) {
+                    slots.emplace_back(tree.nodes.ref_of(n), &Node::left);
+                }
+            }
+            if (!slots.empty()) {
+                throw std::runtime_error("Error: the serialized tree has fewer values than places.\n");
+            }
+            tree.size = static_cast<uint>(count);
+            if constexpr (Layout::has_size) {
+                tree.walk<Order::post>(tree.root_node(), [&tree](Node *n) {
+                    n->count = 1;
+                    for (Node *child : {tree.nodes.get(n->left), tree.nodes.get(n->right)}) {
+                        if (child != nullptr) {
+                            n->count += child->count;
+                        }
+                    }
+                });
+            }
+            *this = std::move(tree);
+            return *this;
+        }
+
+        /**
+         * Print the tree like operator<<, within limits:
+         *   tree.print(std::cout, {.max_depth = 6, .max_nodes = 1000});
+         * Each subtree left out is drawn as one "..." line, with its number
+         * of nodes when the layout counts them (layout::counted). The work
+         * is proportional to the lines printed - subtrees left out are
+         * never walked.
+         */
+        std::ostream &print(std::ostream &os, const PrintLimits &limits = {}) const {
+            size_t len = 0;
+            if (limits.max_nodes >= size && limits.max_depth >= size) {
+                len = calc_len();
+            } else {  // measure just what is printed, so values left out don't widen the cells
+                print_lines(limits, [&len](const Node *node, bool /*isRight*/, bool elided, size_t /*prefix_len*/) {
+                    if (!elided) {
+                        len = std::max(len, width_of(node->value));
+                    }
+                    return size_t{0};
+                });
+            }
+            std::ostringstream stream;  // formats the values like os would
+            stream.copyfmt(os);
+            auto cell = [&stream](std::string &out, const T &value, size_t width) {
+                stream.str("");
+                stream << std::setw(static_cast<int>(width)) << value;
+                out += stream.view();
+            };
+            auto sink = [&os](std::string_view text) { os.write(text.data(), static_cast<std::streamsize>(text.size())); };
+            draw(sink, cell, std::max<size_t>(len, 1), limits);
+            return os;
+        }
+
+        /**
+         * Like print(os, limits), for output that doesn't go through a stream
+         * (see TreeFormat.hpp): the text is handed to sink(std::string_view)
+         * in large blocks, and cell(out, value, width) appends a value to the
+         * string out, right aligned in width characters - or as it is, for
+         * width 0. The width is measured with cell on the printed values.
+         */
+        template<typename Sink, typename Cell>
+        void print_to(Sink sink, Cell cell, const PrintLimits &limits = {}) const {
+            size_t len = 0;
+            std::string text;
+            print_lines(limits, [&](const Node *node, bool /*isRight*/, bool elided, size_t /*prefix_len*/) {
+                if (!elided) {
+                    text.clear();
+                    cell(text, node->value, 0);
+                    len = std::max(len, text.size());
+                }
+                return size_t{0};
+            });
+            draw(sink, cell, std::max<size_t>(len, 1), limits);
+        }
+
+        friend std::ostream &operator<<(std::ostream &os, const BinaryTree &tree) { return tree.print(os); }
+
+        /**
+         * Base of the iterators, for pulling values in batches. Works through
+         * the Iterator's operator*, operator++ and its comparison with
+         * std::default_sentinel.
+         * @tparam V the value type the Iterator gives, T or const T.
+         */
+        template<typename Iterator, typename V>
+        struct Batched {
+            /**
+             * Pull the next values in one call: fill out with pointers to
+             * them and move past them.
+             * @return how many were filled - less than out.size() only at the end.
+             */
+            size_t next_batch(std::span<V *> out) {
+                auto &it = static_cast<Iterator &>(*this);
+                size_t n = 0;
+                for (; n < out.size() && !(it == std::default_sentinel); ++n) {
+                    out[n] = &*it;
+                    ++it;
+                }
+                return n;
+            }
+
+            /**
+             * Like next_batch(span of pointers), copying the values into out.
+             */
+            size_t next_batch(std::span<std::remove_const_t<V>> out) {
+                auto &it = static_cast<Iterator &>(*this);
+                size_t n = 0;
+                for (; n < out.size() && !(it == std::default_sentinel); ++n) {
+                    out[n] = *it;
+                    ++it;
+                }
+                return n;
+            }
+        };  // END Batched class
+
+        /**
+         * Iterator for the plain layout - keeps the nodes above it on a stack.
+         * The traversal order is fixed at compile time; the end of a traversal
+         * is std::default_sentinel. A Const iterator walks const nodes and
+         * gives const values.
+         */
+        template<Order O, bool Const = false>
+        struct StackIterator : Batched<StackIterator<O, Const>, std::conditional_t<Const, const T, T>> {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using reference = std::conditional_t<Const, const T &, T &>;
+            using pointer = std::conditional_t<Const, const T *, T *>;
+
+        private:
+            template<Order, bool>
+            friend struct StackIterator;
+
+            using node_ptr = std::conditional_t<Const, const Node *, Node *>;
+
+            node_ptr curr;
+            const pool *nodes;
+            std::vector<node_ptr> stack;
+            node_ptr prev;
+
+            node_ptr left(const Node *n) const { return nodes->get(n->left); }
+
+            node_ptr right(const Node *n) const { return nodes->get(n->right); }
+
+            void insert_left(node_ptr n) {
+                while (n != nullptr) {
+                    nodes->prefetch(right(n));  // visited once n's left subtree is done
+                    stack.push_back(n);
+                    n = left(n);
+                }
+            }
+
+            void pre_plus() {
+                if (!stack.empty()) {
+                    curr = stack.back();
+                    stack.pop_back();
+                    if (right(curr)) {
+                        nodes->prefetch(right(curr));
+                        stack.push_back(right(curr));
+                    }
+                    if (left(curr)) {
+                        nodes->prefetch(left(curr));
+                        stack.push_back(left(curr));
+                    }
+                } else {
+                    curr = nullptr;
+                }
+            }
+
+            // Base on:
+            // https://www.geeksforgeeks.org/inorder-tree-traversal-without-recursion/
+            void in_plus() {
+                if (!stack.empty()) {
+                    curr = stack.back();
+                    stack.pop_back();
+                    insert_left(right(curr));
+                } else {
+                    curr = nullptr;
+                }
+            }
+
+            // Base on:
+            // https://www.geeksforgeeks.org/iterative-postorder-traversal-using-stack/
+            void post_plus() {
+                while (!stack.empty()) {
+                    node_ptr current = stack.back();
+
+                    // go down the tree in search of a leaf an if so process it and pop stack otherwise move down
+                    if (prev == nullptr || left(prev) == current ||
+                        right(prev) == current) {
+                        if (left(current) != nullptr) {
+                            stack.push_back(left(current));
+                        } else if (right(current) != nullptr) {
+                            stack.push_back(right(current));
+                        } else {
+                            stack.pop_back();
+                            curr = current;
+                            prev = current;
+                            return;
+                        }
+                        // go up the tree from left node, if the child is right
+                        // push it onto stack otherwise process parent and pop stack
+                    } else if (left(current) == prev) {
+                        if (right(current) != nullptr) {
+                            stack.push_back(right(current));
+                        } else {
+                            stack.pop_back();
+                            curr = current;
+                            prev = current;
+                            return;
+                        }
+                        // go up the tree from right node and after coming back
+                        // from right node process parent and pop stack
+                    } else if (right(current) == prev) {
+                        stack.pop_back();
+                        curr = current;
+                        prev = current;
+                        return;
+                    }
+                    prev = current;
+                }
+                curr = nullptr;
+            }
+
+        public:
+            StackIterator() : curr(nullptr), nodes(nullptr), prev(nullptr) {}
+
+            StackIterator(node_ptr n, const pool *nodes) : curr(n), nodes(nodes), prev(nullptr) {
+                if (n == nullptr) {
+                    return;
+                }
+
+                if constexpr (O == Order::pre) {
+                    if (right(curr)) {
+                        stack.push_back(right(curr));
+                    }
+                    if (left(curr)) {
+                        stack.push_back(left(curr));
+                    }
+                } else if constexpr (O == Order::in) {
+                    insert_left(n);
                     in_plus();
                 } else {
+                    stack.push_back(curr);
                     post_plus();
                 }
-                return *this;
             }
 
-            Iterator operator++(int) {
-                Iterator temp = *this;
-                if (type == -1) {
+            // a mutable iterator converts to a const one
+            template<bool C = Const, typename = std::enable_if_t<C>>
+            StackIterator(const StackIterator<O, false> &other)
+                    : curr(other.curr), nodes(other.nodes), stack(other.stack.begin(), other.stack.end()),
+                      prev(other.prev) {}
+
+            reference operator*() const { return curr->value; }
+
+            auto operator->() const { return &(curr->value); }
+
+            StackIterator &operator++() {
+                if constexpr (O == Order::pre) {
                     pre_plus();
-                } else if (type == 0) {
+                } else if constexpr (O == Order::in) {
                     in_plus();
                 } else {
                     post_plus();
                 }
+                return *this;
+            }
+
+            /**
+             * Move k steps forward, one by one. Moving past the end gives end.
+             */
+            StackIterator &advance(std::ptrdiff_t k) {
+                for (; k > 0 && curr != nullptr; --k) {
+                    ++*this;
+                }
+                return *this;
+            }
+
+            StackIterator operator++(int) {
+                StackIterator temp = *this;
+                ++*this;
                 return temp;
             }
 
-            bool operator==(const Iterator &rhs) const { return curr == rhs.curr; }
+            // iterators of different orders are equal when they stand on the same node
+            template<Order P, bool C>
+            bool operator==(const StackIterator<P, C> &rhs) const { return curr == rhs.curr; }
+
+            bool operator==(std::default_sentinel_t /*end*/) const { return curr == nullptr; }
+
+        };  // END StackIterator class
+
+        /**
+         * Iterator for the linked layout - finds the next node through the
+         * parent links, so it needs no stack and can also step backwards.
+         * The end of a traversal is an iterator too, so it can be decremented.
+         * A Const iterator walks const nodes and gives const values.
+         */
+        template<Order O, bool Const = false>
+        struct LinkedIterator : Batched<LinkedIterator<O, Const>, std::conditional_t<Const, const T, T>> {
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using reference = std::conditional_t<Const, const T &, T &>;
+            using pointer = std::conditional_t<Const, const T *, T *>;
+
+        private:
+            template<Order, bool>
+            friend struct LinkedIterator;
 
-            bool operator!=(const Iterator &rhs) const { return curr != rhs.curr; }
+            using node_ptr = std::conditional_t<Const, const Node *, Node *>;
 
-        };  // END Iterator class
+            node_ptr curr;
+            node_ptr root;  // for stepping back from the end
+            const pool *nodes;
 
-        Iterator begin_preorder() { return Iterator{root, -1}; }
-        Iterator end_preorder() { return Iterator{nullptr, -1}; }
-        Iterator begin_inorder() { return Iterator{root, 0}; }
-        Iterator end_inorder() { return Iterator{nullptr, 0}; }
-        Iterator begin_postorder() { return Iterator{root, 1}; }
-        Iterator end_postorder() { return Iterator{nullptr, 1}; }
-        Iterator begin() { return begin_inorder(); }
-        Iterator end() { return end_inorder(); }
+            node_ptr left(const Node *n) const { return nodes->get(n->left); }
+
+            node_ptr right(const Node *n) const { return nodes->get(n->right); }
+
+            node_ptr up(const Node *n) const { return nodes->get(n->parent); }
+
+            size_t count(const Node *n) const {
+                if constexpr (Layout::has_size) {
+                    return n == nullptr ? 0 : n->count;
+                } else {
+                    return 0;
+                }
+            }
+
+            // position of curr in the traversal, from the subtree sizes of
+            // the nodes on its way up - the end is at the size of the tree.
+            size_t rank() const {
+                if (curr == nullptr) {
+                    return count(root);
+                }
+                size_t r = 0;
+                if constexpr (O == Order::in) {
+                    r = count(left(curr));
+                } else if constexpr (O == Order::post) {
+                    r = count(left(curr)) + count(right(curr));
+                }
+                for (node_ptr c = curr, p = up(c); p != nullptr; c = p, p = up(p)) {
+                    bool from_right = right(p) == c;
+                    if constexpr (O == Order::pre) {
+                        r += from_right ? 1 + count(left(p)) : 1;
+                    } else if constexpr (O == Order::in) {
+                        r += from_right ? count(left(p)) + 1 : 0;
+                    } else {
+                        r += from_right ? count(left(p)) : 0;
+                    }
+                }
+                return r;
+            }
+
+            // the k-th node of the traversal, going down from the root by the
+            // subtree sizes.
+            node_ptr nth(size_t k) const {
+                node_ptr n = root;
+                while (n != nullptr) {
+                    size_t l = count(left(n));
+                    if constexpr (O == Order::pre) {
+                        if (k == 0) {
+                            return n;
+                        }
+                        --k;
+                        if (k < l) {
+                            n = left(n);
+                        } else {
+                            k -= l;
+                            n = right(n);
+                        }
+                    } else if constexpr (O == Order::in) {
+                        if (k < l) {
+                            n = left(n);
+                        } else if (k == l) {
+                            return n;
+                        } else {
+                            k -= l + 1;
+                            n = right(n);
+                        }
+                    } else {
+                        size_t r = count(right(n));
+                        if (k < l) {
+                            n = left(n);
+                        } else if (k < l + r) {
+                            k -= l;
+                            n = right(n);
+                        } else {
+                            return n;
+                        }
+                    }
+                }
+                return nullptr;
+            }
+
+            node_ptr leftmost(node_ptr n) const {
+                while (left(n) != nullptr) {
+                    n = left(n);
+                }
+                return n;
+            }
+
+            node_ptr rightmost(node_ptr n) const {
+                while (right(n) != nullptr) {
+                    n = right(n);
+                }
+                return n;
+            }
+
+            // the first node of n's subtree in postorder: the deepest node
+            // reached by going left whenever possible.
+            node_ptr first_post(node_ptr n) const {
+                while (true) {
+                    if (left(n) != nullptr) {
+                        n = left(n);
+                    } else if (right(n) != nullptr) {
+                        n = right(n);
+                    } else {
+                        return n;
+                    }
+                }
+            }
+
+            // the last node of n's subtree in preorder: the deepest node
+            // reached by going right whenever possible.
+            node_ptr last_pre(node_ptr n) const {
+                while (true) {
+                    if (right(n) != nullptr) {
+                        n = right(n);
+                    } else if (left(n) != nullptr) {
+                        n = left(n);
+                    } else {
+                        return n;
+                    }
+                }
+            }
+
+            node_ptr pre_next(node_ptr n) const {
+                if (left(n) != nullptr) {
+                    return left(n);
+                }
+                if (right(n) != nullptr) {
+                    return right(n);
+                }
+                // climb until we come up from a left child with a right sibling
+                for (node_ptr p = up(n); p != nullptr; n = p, p = up(p)) {
+                    if (left(p) == n && right(p) != nullptr) {
+                        return right(p);
+                    }
+                }
+                return nullptr;
+            }
+
+            node_ptr pre_prev(node_ptr n) const {
+                node_ptr p = up(n);
+                if (p == nullptr || left(p) == n || left(p) == nullptr) {
+                    return p;
+                }
+                return last_pre(left(p));
+            }
+
+            node_ptr in_next(node_ptr n) const {
+                if (right(n) != nullptr) {
+                    return leftmost(right(n));
+                }
+                node_ptr p = up(n);
+                while (p != nullptr && right(p) == n) {
+                    n = p;
+                    p = up(p);
+                }
+                return p;
+            }
+
+            node_ptr in_prev(node_ptr n) const {
+                if (left(n) != nullptr) {
+                    return rightmost(left(n));
+                }
+                node_ptr p = up(n);
+                while (p != nullptr && left(p) == n) {
+                    n = p;
+                    p = up(p);
+                }
+                return p;
+            }
+
+            node_ptr post_next(node_ptr n) const {
+                node_ptr p = up(n);
+                if (p != nullptr && left(p) == n && right(p) != nullptr) {
+                    return first_post(right(p));
+                }
+                return p;
+            }
+
+            node_ptr post_prev(node_ptr n) const {
+                if (right(n) != nullptr) {
+                    return right(n);
+                }
+                if (left(n) != nullptr) {
+                    return left(n);
+                }
+                // climb until we come up from a right child with a left sibling
+                for (node_ptr p = up(n); p != nullptr; n = p, p = up(p)) {
+                    if (right(p) == n && left(p) != nullptr) {
+                        return left(p);
+                    }
+                }
+                return nullptr;
+            }
+
+        public:
+            LinkedIterator() : curr(nullptr), root(nullptr), nodes(nullptr) {}
+
+            LinkedIterator(node_ptr root, const pool *nodes, bool end)
+                    : curr(nullptr), root(root), nodes(nodes) {
+                if (root == nullptr || end) {
+                    return;
+                }
+                if constexpr (O == Order::pre) {
+                    curr = root;
+                } else if constexpr (O == Order::in) {
+                    curr = leftmost(root);
+                } else {
+                    curr = first_post(root);
+                }
+            }
+
+            // a mutable iterator converts to a const one
+            template<bool C = Const, typename = std::enable_if_t<C>>
+            LinkedIterator(const LinkedIterator<O, false> &other)
+                    : curr(other.curr), root(other.root), nodes(other.nodes) {}
+
+            reference operator*() const { return curr->value; }
+
+            auto operator->() const { return &(curr->value); }
+
+            LinkedIterator &operator++() {
+                if constexpr (O == Order::pre) {
+                    curr = pre_next(curr);
+                } else if constexpr (O == Order::in) {
+                    curr = in_next(curr);
+                } else {
+                    curr = post_next(curr);
+                }
+                return *this;
+            }
+
+            LinkedIterator operator++(int) {
+                LinkedIterator temp = *this;
+                ++*this;
+                return temp;
+            }
+
+            /**
+             * Move k steps, backwards if k is negative. O(height) with the
+             * counted layout, O(k) otherwise. Moving past either end gives end.
+             */
+            LinkedIterator &advance(std::ptrdiff_t k) {
+                if constexpr (Layout::has_size) {
+                    std::ptrdiff_t target = static_cast<std::ptrdiff_t>(rank()) + k;
+                    if (target < 0 || target >= static_cast<std::ptrdiff_t>(count(root))) {
+                        curr = nullptr;
+                    } else {
+                        curr = nth(static_cast<size_t>(target));
+                    }
+                } else {
+                    for (; k > 0 && curr != nullptr; --k) {
+                        ++*this;
+                    }
+                    for (; k < 0; ++k) {
+                        --*this;
+                        if (curr == nullptr) {
+                            break;
+                        }
+                    }
+                }
+                return *this;
+            }
+
+            LinkedIterator &operator--() {
+                if (curr == nullptr) {  // from the end - the last node
+                    if constexpr (O == Order::pre) {
+                        curr = last_pre(root);
+                    } else if constexpr (O == Order::in) {
+                        curr = rightmost(root);
+                    } else {
+                        curr = root;
+                    }
+                } else if constexpr (O == Order::pre) {
+                    curr = pre_prev(curr);
+                } else if constexpr (O == Order::in) {
+                    curr = in_prev(curr);
+                } else {
+                    curr = post_prev(curr);
+                }
+                return *this;
+            }
+
+            LinkedIterator operator--(int) {
+                LinkedIterator temp = *this;
+                --*this;
+                return temp;
+            }
+
+            // iterators of different orders are equal when they stand on the same node
+            template<Order P, bool C>
+            bool operator==(const LinkedIterator<P, C> &rhs) const { return curr == rhs.curr; }
+
+            bool operator==(std::default_sentinel_t /*end*/) const { return curr == nullptr; }
+
+        };  // END LinkedIterator class
+
+        /**
+         * A node and its subtrees, for algorithms that walk the tree their own
+         * way (see ParallelTree.hpp). A Const cursor gives const values.
+         * An empty cursor stands for a missing child.
+         */
+        template<bool Const = false>
+        class Cursor {
+        private:
+            using node_ptr = std::conditional_t<Const, const Node *, Node *>;
+            using reference = std::conditional_t<Const, const T &, T &>;
+
+            node_ptr node;
+            const pool *nodes;
+
+        public:
+            Cursor() : node(nullptr), nodes(nullptr) {}
+
+            Cursor(node_ptr node, const pool *nodes) : node(node), nodes(nodes) {}
+
+            explicit operator bool() const { return node != nullptr; }
+
+            reference operator*() const { return node->value; }
+
+            auto operator->() const { return &(node->value); }
+
+            Cursor left() const { return Cursor{nodes->get(node->left), nodes}; }
+
+            Cursor right() const { return Cursor{nodes->get(node->right), nodes}; }
+
+            bool operator==(const Cursor &rhs) const { return node == rhs.node; }
+        };  // END Cursor class
+
+        Cursor<> root_cursor() {
+            exposed();
+            return Cursor<>{root_node(), &nodes};
+        }
+
+        Cursor<true> root_cursor() const { return Cursor<true>{root_node(), &nodes}; }
+
+        /**
+         * Queue entry of a level order traversal: a node and its depth.
+         */
+        struct LevelItem {
+            Node *node;
+            size_t depth;
+        };
+
+        /**
+         * Buffer for level order traversals. Pass one to begin_levelorder to
+         * reuse its memory across traversals.
+         */
+        using LevelBuffer = RingQueue<LevelItem>;
+
+        /**
+         * Level order (breadth first) iterator, over a ring buffer queue of
+         * the nodes of the next levels. The end of a traversal is
+         * std::default_sentinel.
+         * An iterator over a borrowed buffer is single pass: its copies share
+         * the buffer, so only one of them may be advanced.
+         */
+        template<bool Const = false>
+        struct LevelIterator : Batched<LevelIterator<Const>, std::conditional_t<Const, const T, T>> {
+        public:
+            // single pass over a borrowed buffer, so only an input iterator
+            using iterator_category = std::input_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using reference = std::conditional_t<Const, const T &, T &>;
+            using pointer = std::conditional_t<Const, const T *, T *>;
+
+        private:
+            template<bool>
+            friend struct LevelIterator;
+
+            using node_ptr = std::conditional_t<Const, const Node *, Node *>;
+
+            node_ptr curr;
+            size_t level;
+            const pool *nodes;
+            std::unique_ptr<LevelBuffer> own;
+            LevelBuffer *queue;
+
+            void load() {
+                if (queue->empty()) {
+                    curr = nullptr;
+                } else {
+                    curr = queue->front().node;
+                    level = queue->front().depth;
+                }
+            }
+
+        public:
+            /**
+             * @param buffer queue to use, nullptr to allocate one.
+             */
+            LevelIterator(Node *root, const pool *nodes, LevelBuffer *buffer)
+                    : curr(nullptr), level(0), nodes(nodes),
+                      own(buffer == nullptr ? std::make_unique<LevelBuffer>() : nullptr),
+                      queue(buffer == nullptr ? own.get() : buffer) {
+                queue->clear();
+                if (root != nullptr) {
+                    queue->push(LevelItem{root, 0});
+                }
+                load();
+            }
+
+            LevelIterator(const LevelIterator &other)
+                    : curr(other.curr), level(other.level), nodes(other.nodes),
+                      own(other.own ? std::make_unique<LevelBuffer>(*other.own) : nullptr),
+                      queue(other.own ? own.get() : other.queue) {}
+
+            LevelIterator(LevelIterator &&other) noexcept = default;
+
+            LevelIterator &operator=(const LevelIterator &other) {
+                if (this != &other) {
+                    *this = LevelIterator(other);
+                }
+                return *this;
+            }
+
+            LevelIterator &operator=(LevelIterator &&other) noexcept = default;
+
+            ~LevelIterator() = default;
+
+            // a mutable iterator converts to a const one
+            template<bool C = Const, typename = std::enable_if_t<C>>
+            LevelIterator(const LevelIterator<false> &other)
+                    : curr(other.curr), level(other.level), nodes(other.nodes),
+                      own(other.own ? std::make_unique<LevelBuffer>(*other.own) : nullptr),
+                      queue(other.own ? own.get() : other.queue) {}
+
+            reference operator*() const { return curr->value; }
+
+            auto operator->() const { return &(curr->value); }
+
+            /**
+             * Depth of the current node, 0 for the root.
+             */
+            size_t depth() const { return level; }
+
+            LevelIterator &operator++() {
+                Node *n = queue->front().node;
+                queue->pop();
+                if (Node *l = nodes->get(n->left)) {
+                    queue->push(LevelItem{l, level + 1});
+                }
+                if (Node *r = nodes->get(n->right)) {
+                    queue->push(LevelItem{r, level + 1});
+                }
+                load();
+                return *this;
+            }
+
+            LevelIterator operator++(int) {
+                LevelIterator temp = *this;
+                ++*this;
+                return temp;
+            }
+
+            template<bool C>
+            bool operator==(const LevelIterator<C> &rhs) const { return curr == rhs.curr; }
+
+            bool operator==(std::default_sentinel_t /*end*/) const { return curr == nullptr; }
+
+        };  // END LevelIterator class
+
+        // over the cached traversal, when there is a cache
+        template<bool Const = false>
+        using CachedIterator = typename FlatView<std::conditional_t<Const, const T, T>>::iterator;
+
+        template<Order O, bool Const = false>
+        using OrderIterator = std::conditional_t<Cache::enabled, CachedIterator<Const>,
+                std::conditional_t<Layout::has_parent, LinkedIterator<O, Const>, StackIterator<O, Const>>>;
+
+        // what end_*() returns: an iterator for the cache and the linked layout, a sentinel otherwise
+        template<Order O, bool Const = false>
+        using OrderEnd = std::conditional_t<Cache::enabled || Layout::has_parent, OrderIterator<O, Const>,
+                std::default_sentinel_t>;
+
+        using PreorderIterator = OrderIterator<Order::pre>;
+        using InorderIterator = OrderIterator<Order::in>;
+        using PostorderIterator = OrderIterator<Order::post>;
+        using Iterator = InorderIterator;
+
+        using ConstPreorderIterator = OrderIterator<Order::pre, true>;
+        using ConstInorderIterator = OrderIterator<Order::in, true>;
+        using ConstPostorderIterator = OrderIterator<Order::post, true>;
+        using ConstIterator = ConstInorderIterator;
+
+        // a traversal as a range: its begin iterator and its end
+        template<Order O, bool Const = false>
+        using OrderView = std::ranges::subrange<OrderIterator<O, Const>, OrderEnd<O, Const>>;
+
+    private:
+        // the cached traversal in order O, walked again if the tree changed
+        template<Order O>
+        const std::vector<T *> &cached() const {
+            return orders.get(static_cast<size_t>(O), [this] { return flat<T>(root_node(), O); });
+        }
+
+        template<Order O, bool Const>
+        OrderIterator<O, Const> make_begin() const {
+            if constexpr (!Const) {
+                exposed();
+            }
+            if constexpr (Cache::enabled) {
+                const std::vector<T *> &items = cached<O>();
+                return OrderIterator<O, Const>{items.data(), items.data() + items.size()};
+            } else if constexpr (Layout::has_parent) {
+                return OrderIterator<O, Const>{root_node(), &nodes, false};
+            } else {
+                return OrderIterator<O, Const>{root_node(), &nodes};
+            }
+        }
+
+        template<Order O>
+        OrderIterator<O> nth(size_t k) {
+            static_assert(Layout::has_size || Cache::enabled,
+                          "nth_* needs subtree sizes or a cache - use layout::counted or cache::orders");
+            auto it = make_begin<O, false>();
+            if constexpr (Cache::enabled) {
+                it += static_cast<std::ptrdiff_t>(std::min<size_t>(k, size));
+            } else {
+                it.advance(static_cast<std::ptrdiff_t>(k));
+            }
+            return it;
+        }
+
+        template<Order O, bool Const>
+        OrderEnd<O, Const> make_end() const {
+            if constexpr (!Const) {
+                exposed();  // a bidirectional end walks back
+            }
+            if constexpr (Cache::enabled) {
+                const std::vector<T *> &items = cached<O>();
+                return OrderEnd<O, Const>{items.data() + items.size(), items.data() + items.size()};
+            } else if constexpr (Layout::has_parent) {
+                return OrderEnd<O, Const>{root_node(), &nodes, true};
+            } else {
+                return std::default_sentinel;
+            }
+        }
+
+    public:
+        PreorderIterator begin_preorder() { return make_begin<Order::pre, false>(); }
+        OrderEnd<Order::pre> end_preorder() { return make_end<Order::pre, false>(); }
+        InorderIterator begin_inorder() { return make_begin<Order::in, false>(); }
+        OrderEnd<Order::in> end_inorder() { return make_end<Order::in, false>(); }
+        PostorderIterator begin_postorder() { return make_begin<Order::post, false>(); }
+        OrderEnd<Order::post> end_postorder() { return make_end<Order::post, false>(); }
+        InorderIterator begin() { return begin_inorder(); }
+        OrderEnd<Order::in> end() { return end_inorder(); }
+
+        // Read-only traversal. Const iterators only read the nodes, so any
+        // number of threads may walk the same tree at once while no one changes it.
+        ConstPreorderIterator cbegin_preorder() const { return make_begin<Order::pre, true>(); }
+        OrderEnd<Order::pre, true> cend_preorder() const { return make_end<Order::pre, true>(); }
+        ConstInorderIterator cbegin_inorder() const { return make_begin<Order::in, true>(); }
+        OrderEnd<Order::in, true> cend_inorder() const { return make_end<Order::in, true>(); }
+        ConstPostorderIterator cbegin_postorder() const { return make_begin<Order::post, true>(); }
+        OrderEnd<Order::post, true> cend_postorder() const { return make_end<Order::post, true>(); }
+        ConstInorderIterator cbegin() const { return cbegin_inorder(); }
+        OrderEnd<Order::in, true> cend() const { return cend_inorder(); }
+        ConstInorderIterator begin() const { return cbegin_inorder(); }
+        OrderEnd<Order::in, true> end() const { return cend_inorder(); }
+
+        /**
+         * The traversals as std::ranges views, for lazy pipelines:
+         *   tree.inorder_view() | std::views::filter(odd) | std::views::take(10)
+         * Nothing is copied; the tree must outlive the view.
+         */
+        OrderView<Order::pre> preorder_view() { return {begin_preorder(), end_preorder()}; }
+        OrderView<Order::in> inorder_view() { return {begin_inorder(), end_inorder()}; }
+        OrderView<Order::post> postorder_view() { return {begin_postorder(), end_postorder()}; }
+        OrderView<Order::pre, true> preorder_view() const { return {cbegin_preorder(), cend_preorder()}; }
+        OrderView<Order::in, true> inorder_view() const { return {cbegin_inorder(), cend_inorder()}; }
+        OrderView<Order::post, true> postorder_view() const { return {cbegin_postorder(), cend_postorder()}; }
+
+        /**
+         * Iterator at the k-th node (from 0) of a traversal, end if the tree
+         * has no more than k nodes. Needs the counted layout, and takes
+         * O(height), or the orders cache, and takes O(1) once cached.
+         */
+        PreorderIterator nth_preorder(size_t k) { return nth<Order::pre>(k); }
+        InorderIterator nth_inorder(size_t k) { return nth<Order::in>(k); }
+        PostorderIterator nth_postorder(size_t k) { return nth<Order::post>(k); }
+
+        /**
+         * Level order traversal - by depth, left to right.
+         * @param buffer queue to reuse, instead of allocating one per traversal.
+         */
+        LevelIterator<> begin_levelorder() {
+            exposed();
+            return LevelIterator<>{root_node(), &nodes, nullptr};
+        }
+        LevelIterator<> begin_levelorder(LevelBuffer &buffer) {
+            exposed();
+            return LevelIterator<>{root_node(), &nodes, &buffer};
+        }
+        std::default_sentinel_t end_levelorder() const { return std::default_sentinel; }
+        LevelIterator<true> cbegin_levelorder() const { return LevelIterator<true>{root_node(), &nodes, nullptr}; }
+        LevelIterator<true> cbegin_levelorder(LevelBuffer &buffer) const {
+            return LevelIterator<true>{root_node(), &nodes, &buffer};
+        }
+        std::default_sentinel_t cend_levelorder() const { return std::default_sentinel; }
     };
-}  // namespace ariel
\ No newline at end of file
+}  // namespace ariel
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ariel {
+
+    /**
+     * Random access view of the values of a tree, in the order of one
+     * traversal, over a vector of pointers to them. Made by
+     * BinaryTree::flatten, for algorithms that need random access
+     * iterators - std::sort, std::execution::par and friends. Its iterator
+     * is also the iterator of trees with a traversal cache.
+     * The values are the tree's own: writing through a view writes to the
+     * tree. A view is a snapshot of the shape, so it goes stale once nodes
+     * are added.
+     * @tparam V value type, const for a view of a const tree.
+     */
+    template<typename V>
+    class FlatView {
+    private:
+        std::vector<V *> items;
+
+    public:
+        class iterator {
+        private:
+            template<typename>
+            friend class FlatView;
+
+            V *const *at;
+            V *const *last;  // end of the array, for next_batch
+
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using iterator_concept = std::random_access_iterator_tag;
+            using value_type = std::remove_cv_t<V>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = V *;
+            using reference = V &;
+
+            iterator() : at(nullptr), last(nullptr) {}
+
+            iterator(V *const *at, V *const *last) : at(at), last(last) {}
+
+            // a mutable iterator converts to a const one
+            template<typename W = V, typename = std::enable_if_t<std::is_const_v<W>>>
+            iterator(const typename FlatView<std::remove_const_t<W>>::iterator &other) : at(other.at), last(other.last) {}
+
+            reference operator*() const { return **at; }
+
+            pointer operator->() const { return *at; }
+
+            reference operator[](difference_type k) const { return *at[k]; }
+
+            iterator &operator++() {
+                ++at;
+                return *this;
+            }
+
+            iterator operator++(int) {
+                iterator temp = *this;
+                ++at;
+                return temp;
+            }
+
+            iterator &operator--() {
+                --at;
+                return *this;
+            }
+
+            iterator operator--(int) {
+                iterator temp = *this;
+                --at;
+                return temp;
+            }
+
+            iterator &operator+=(difference_type k) {
+                at += k;
+                return *this;
+            }
+
+            iterator &operator-=(difference_type k) {
+                at -= k;
+                return *this;
+            }
+
+            /**
+             * Pull the next values in one call: fill out with pointers to
+             * them and move past them.
+             * @return how many were filled - less than out.size() only at the end.
+             */
+            size_t next_batch(std::span<V *> out) {
+                size_t n = std::min(out.size(), static_cast<size_t>(last - at));
+                std::copy_n(at, n, out.begin());
+                at += n;
+                return n;
+            }
+
+            /**
+             * Like next_batch(span of pointers), copying the values into out.
+             */
+            size_t next_batch(std::span<std::remove_const_t<V>> out) {
+                size_t n = std::min(out.size(), static_cast<size_t>(last - at));
+                for (size_t i = 0; i < n; ++i) {
+                    out[i] = *at[i];
+                }
+                at += n;
+                return n;
+            }
+
+            friend iterator operator+(iterator it, difference_type k) { return it += k; }
+
+            friend iterator operator+(difference_type k, iterator it) { return it += k; }
+
+            friend iterator operator-(iterator it, difference_type k) { return it -= k; }
+
+            friend difference_type operator-(const iterator &lhs, const iterator &rhs) { return lhs.at - rhs.at; }
+
+            bool operator==(const iterator &rhs) const { return at == rhs.at; }
+
+            auto operator<=>(const iterator &rhs) const { return at <=> rhs.at; }
+        };  // END iterator class
+
+        FlatView() = default;
+
+        explicit FlatView(std::vector<V *> items) : items(std::move(items)) {}
+
+        iterator begin() const { return iterator{items.data(), items.data() + items.size()}; }
+
+        iterator end() const { return iterator{items.data() + items.size(), items.data() + items.size()}; }
+
+        size_t size() const { return items.size(); }
+
+        bool empty() const { return items.empty(); }
+
+        V &operator[](size_t k) const { return *items[k]; }
+    };
+
+}  // namespace ariel
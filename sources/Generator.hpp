@@ -0,0 +1,139 @@
+#pragma once
+
+// coroutine traversals are left out on compilers without C++20 coroutines
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#define ARIEL_HAS_GENERATOR 1
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+namespace ariel {
+
+    /**
+     * Lazy sequence produced by a coroutine that co_yields references, in
+     * the spirit of C++23 std::generator. One coroutine frame per
+     * generator; each element is a pointer to the yielded object, so
+     * nothing is allocated or copied per element. Move-only, single pass,
+     * and a std::ranges::input_range / view.
+     * @tparam R reference type of the elements, T& or const T&.
+     */
+    template<typename R>
+    class Generator : public std::ranges::view_base {
+        static_assert(std::is_reference_v<R>, "Generator yields references");
+
+    public:
+        using value_type = std::remove_cvref_t<R>;
+
+        struct promise_type {
+            std::add_pointer_t<R> current = nullptr;
+            std::exception_ptr error;
+
+            Generator get_return_object() {
+                return Generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            std::suspend_always final_suspend() noexcept { return {}; }
+
+            std::suspend_always yield_value(R value) noexcept {
+                current = std::addressof(value);
+                return {};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() { error = std::current_exception(); }
+
+            // co_await is not for generators
+            template<typename U>
+            void await_transform(U &&) = delete;
+        };
+
+        class iterator {
+        private:
+            std::coroutine_handle<promise_type> coroutine;
+
+        public:
+            using iterator_concept = std::input_iterator_tag;
+            using value_type = std::remove_cvref_t<R>;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+
+            explicit iterator(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+
+            R operator*() const { return static_cast<R>(*coroutine.promise().current); }
+
+            auto operator->() const { return coroutine.promise().current; }
+
+            iterator &operator++() {
+                resume(coroutine);
+                return *this;
+            }
+
+            void operator++(int) { ++*this; }
+
+            bool operator==(std::default_sentinel_t /*end*/) const { return !coroutine || coroutine.done(); }
+        };  // END iterator class
+
+        Generator() = default;
+
+        Generator(Generator &&other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+        Generator &operator=(Generator &&other) noexcept {
+            if (this != &other) {
+                destroy();
+                coroutine = std::exchange(other.coroutine, nullptr);
+            }
+            return *this;
+        }
+
+        Generator(const Generator &) = delete;
+
+        Generator &operator=(const Generator &) = delete;
+
+        ~Generator() { destroy(); }
+
+        /**
+         * Starts the coroutine - call once.
+         */
+        iterator begin() {
+            if (coroutine) {
+                resume(coroutine);
+            }
+            return iterator{coroutine};
+        }
+
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    private:
+        std::coroutine_handle<promise_type> coroutine = nullptr;
+
+        explicit Generator(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+
+        void destroy() {
+            if (coroutine) {
+                coroutine.destroy();
+                coroutine = nullptr;
+            }
+        }
+
+        // run to the next co_yield, rethrowing what the coroutine threw
+        static void resume(std::coroutine_handle<promise_type> coroutine) {
+            coroutine.resume();
+            if (coroutine.done() && coroutine.promise().error) {
+                std::rethrow_exception(std::exchange(coroutine.promise().error, nullptr));
+            }
+        }
+    };
+
+}  // namespace ariel
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ * Traversal cache policies for BinaryTree - whether the order traversals
+ * walk the nodes or a flat array made by an earlier traversal.
+ *
+ * A policy exposes:
+ *   enabled          - whether the tree iterates through the cache.
+ *   store<P>         - the cache of one tree, with
+ *                        get(order, fill)  the pointers of a traversal order
+ *                                          (0, 1, 2), from fill() if they
+ *                                          aren't cached yet,
+ *                        invalidate()      the shape of the tree changed.
+ *                      A copied or moved store is empty.
+ */
+namespace ariel::cache {
+
+    /**
+     * No cache - iterators walk the nodes.
+     */
+    struct none {
+        static constexpr bool enabled = false;
+
+        template<typename P>
+        class store {
+        public:
+            void invalidate() {}
+        };
+    };
+
+    /**
+     * Each traversal order is kept as an array of value pointers, made on
+     * its first use and dropped when a node is added. Trees iterated many
+     * times between changes then scan a flat array instead of chasing
+     * child links. Costs a pointer per node for each order in use.
+     * Filling is locked, so const trees can still be read from several
+     * threads at once.
+     */
+    struct orders {
+        static constexpr bool enabled = true;
+
+        template<typename P>
+        class store {
+        private:
+            mutable std::array<std::vector<P>, 3> items;
+            mutable std::array<std::atomic<bool>, 3> valid{};
+            mutable std::mutex lock;
+
+        public:
+            store() = default;
+
+            store(const store & /*other*/) : store() {}
+
+            store(store && /*other*/) noexcept : store() {}
+
+            store &operator=(const store & /*other*/) {
+                invalidate();
+                return *this;
+            }
+
+            store &operator=(store && /*other*/) noexcept {
+                invalidate();
+                return *this;
+            }
+
+            ~store() = default;
+
+            template<typename Fill>
+            const std::vector<P> &get(size_t order, Fill fill) const {
+                if (!valid[order].load(std::memory_order_acquire)) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (!valid[order].load(std::memory_order_relaxed)) {
+                        items[order] = fill();
+                        valid[order].store(true, std::memory_order_release);
+                    }
+                }
+                return items[order];
+            }
+
+            void invalidate() {
+                for (auto &v : valid) {
+                    v.store(false, std::memory_order_relaxed);
+                }
+            }
+        };
+    };
+
+}  // namespace ariel::cache
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Node layout policies for BinaryTree - what a node keeps besides its
+ * value and children.
+ *
+ * A policy exposes:
+ *   has_parent   - whether nodes link to their parent.
+ *   parent<Ref>  - the type of the parent field, given the storage's ref.
+ *   has_size     - whether nodes count the nodes of their subtree.
+ *   size_field   - the type of the subtree size field.
+ */
+namespace ariel::layout {
+
+    // fields a layout leaves out - distinct empty types, so they take no room
+    struct no_parent {};
+    struct no_size {};
+
+    /**
+     * Children only. Iterators keep a stack of the nodes above them.
+     */
+    struct plain {
+        static constexpr bool has_parent = false;
+        static constexpr bool has_size = false;
+
+        template<typename Ref>
+        using parent = no_parent;
+
+        using size_field = no_size;
+    };
+
+    /**
+     * Every node also links to its parent, so iterators walk up the tree
+     * instead of keeping a stack: an iterator is a plain node pointer, steps
+     * in amortized O(1) and can go backwards.
+     */
+    struct linked {
+        static constexpr bool has_parent = true;
+        static constexpr bool has_size = false;
+
+        template<typename Ref>
+        using parent = Ref;
+
+        using size_field = no_size;
+    };
+
+    /**
+     * Like linked, and every node also counts the nodes of its subtree.
+     * Finding the k-th node of a traversal, or advancing an iterator by k,
+     * then takes O(height) instead of O(k). Sizes are kept up to date by
+     * walking the parent links up from each new node.
+     */
+    struct counted {
+        static constexpr bool has_parent = true;
+        static constexpr bool has_size = true;
+
+        template<typename Ref>
+        using parent = Ref;
+
+        using size_field = size_t;
+    };
+
+}  // namespace ariel::layout
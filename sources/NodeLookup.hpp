@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+
+/**
+ * Lookup policies for BinaryTree - how add_left/add_right find the node
+ * holding existing_value.
+ *
+ * A policy exposes table<T, Ref>, kept up to date by the tree, with
+ *   find(value, pool, search)  the first node (in preorder) holding value,
+ *                              nullptr if there is none. search() is the
+ *                              full tree search, used when the table can't
+ *                              answer by itself.
+ *   added(value, node, pool)   node now holds value.
+ *   removed(value, node, pool) node no longer holds value.
+ *   rebuild(pool, each)        values were written behind the table's back:
+ *                              start over from the nodes each(add) passes
+ *                              to add(node).
+ *   clear()                    the tree is empty.
+ */
+namespace ariel::lookup {
+
+    /**
+     * No index - every lookup searches the tree.
+     */
+    struct scan {
+        template<typename T, typename Ref>
+        class table {
+        public:
+            template<typename Pool, typename Search>
+            auto find(const T & /*value*/, const Pool & /*pool*/, Search search) {
+                return search();
+            }
+
+            template<typename Node, typename Pool>
+            void added(const T & /*value*/, const Node * /*n*/, const Pool & /*pool*/) {}
+
+            template<typename Node, typename Pool>
+            void removed(const T & /*value*/, const Node * /*n*/, const Pool & /*pool*/) {}
+
+            template<typename Pool, typename Each>
+            void rebuild(const Pool & /*pool*/, Each /*each*/) {}
+
+            void clear() {}
+        };
+    };
+
+    /**
+     * Hash index from value to node, so a lookup is O(1) on average.
+     * Requires std::hash<T>.
+     *
+     * Each value keeps the number of nodes holding it and its first node in
+     * preorder. When a value is held by more than one node the first one can
+     * change with every insert, so it is forgotten and found again by a
+     * search on the next lookup - unique values never search.
+     * Values written through iterators or handles aren't seen by the table;
+     * once those are handed out the tree searches instead, until reindex().
+     */
+    struct hashed {
+        template<typename T, typename Ref>
+        class table {
+        private:
+            struct entry {
+                Ref first;  // value-initialized when unknown
+                size_t count;
+            };
+
+            std::unordered_map<T, entry> entries;
+
+        public:
+            template<typename Pool, typename Search>
+            auto find(const T &value, const Pool &pool, Search search) {
+                auto it = entries.find(value);
+                if (it == entries.end()) {
+                    return decltype(search()){nullptr};
+                }
+                if (auto n = pool.get(it->second.first); n != nullptr && n->value == value) {
+                    return n;
+                }
+                auto n = search();
+                it->second.first = n == nullptr ? Ref{} : pool.ref_of(n);
+                return n;
+            }
+
+            template<typename Node, typename Pool>
+            void added(const T &value, const Node *n, const Pool &pool) {
+                auto [it, fresh] = entries.try_emplace(value, entry{pool.ref_of(n), 0});
+                if (!fresh) {
+                    it->second.first = Ref{};
+                }
+                ++it->second.count;
+            }
+
+            template<typename Node, typename Pool>
+            void removed(const T &value, const Node *n, const Pool &pool) {
+                auto it = entries.find(value);
+                if (it == entries.end()) {
+                    return;
+                }
+                if (--it->second.count == 0) {
+                    entries.erase(it);
+                } else if (pool.get(it->second.first) == n) {
+                    it->second.first = Ref{};
+                }
+            }
+
+            template<typename Pool, typename Each>
+            void rebuild(const Pool &pool, Each each) {
+                entries.clear();
+                each([&](const auto *n) { added(n->value, n, pool); });
+            }
+
+            void clear() { entries.clear(); }
+        };
+    };
+
+}  // namespace ariel::lookup
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Node storage policies for BinaryTree.
+ *
+ * A policy decides how nodes are allocated and how a node refers to its
+ * children. Each policy exposes:
+ *   link<Node>  - the type of a child link, value-initialized to "no child".
+ *   ref<Node>   - a non-owning reference to a node, that stays valid while
+ *                 the tree grows. Value-initialized means "no node".
+ *   pool<Node>  - owner of the nodes of one tree, with
+ *                   make(args...)   create a node and return a link to it,
+ *                   get(link)       the node behind a link (nullptr if none),
+ *                   ref_of(node)    the ref to a node; get(ref) gives it back,
+ *                   reserve(n)      prepare room for n more nodes, true if
+ *                                   that moved the existing nodes,
+ *                   prefetch(node)  hint that node will be read soon,
+ *                   release(root)   release every node of the tree and
+ *                                   reset root to "no node".
+ */
+namespace ariel::storage {
+
+    /**
+     * Every node lives in its own heap block, owned by a std::shared_ptr.
+     */
+    struct shared {
+        template<typename Node>
+        using link = std::shared_ptr<Node>;
+
+        template<typename Node>
+        using ref = Node *;
+
+        template<typename Node>
+        class pool {
+        public:
+            template<typename... Args>
+            link<Node> make(Args &&... args) {
+                return link<Node>{new Node(std::forward<Args>(args)...)};
+            }
+
+            using ref = storage::shared::ref<Node>;
+
+            Node *get(const link<Node> &l) const { return l.get(); }
+
+            Node *get(ref r) const { return r; }
+
+            ref ref_of(const Node *n) const { return const_cast<Node *>(n); }
+
+            bool reserve(size_t /*n*/) { return false; }
+
+            void prefetch(const Node * /*n*/) const {}
+
+            /**
+             * Detach the nodes one by one, so a deep chain doesn't unwind
+             * one shared_ptr destructor inside the other.
+             */
+            void release(link<Node> &root) {
+                std::vector<link<Node>> todo;
+                if (root) {
+                    todo.push_back(std::move(root));
+                }
+                while (!todo.empty()) {
+                    link<Node> n = std::move(todo.back());
+                    todo.pop_back();
+                    if (n->left) {
+                        todo.push_back(std::move(n->left));
+                    }
+                    if (n->right) {
+                        todo.push_back(std::move(n->right));
+                    }
+                }
+                root = nullptr;
+            }
+        };
+    };
+
+    /**
+     * Nodes are carved out of large contiguous chunks owned by the tree and
+     * linked with raw pointers. The whole tree is released chunk by chunk,
+     * so teardown costs one free per chunk instead of one per node.
+     */
+    struct arena {
+        template<typename Node>
+        using link = Node *;
+
+        template<typename Node>
+        using ref = Node *;
+
+        template<typename Node>
+        class pool {
+        private:
+            struct alignas(Node) slot {
+                unsigned char bytes[sizeof(Node)];
+            };
+
+            struct chunk {
+                std::unique_ptr<slot[]> slots;
+                size_t capacity;
+                size_t used;
+            };
+
+            static constexpr size_t first_chunk = 256;
+            static constexpr size_t max_chunk = size_t{1} << 16;
+
+            std::vector<chunk> chunks;
+
+            size_t next_capacity() const {
+                return chunks.empty() ? first_chunk : std::min(chunks.back().capacity * 2, max_chunk);
+            }
+
+            void grow(size_t capacity) {
+                // slots are left uninitialized - make() constructs the nodes in place.
+                chunks.push_back(chunk{std::unique_ptr<slot[]>(new slot[capacity]), capacity, 0});
+            }
+
+        public:
+            pool() = default;
+
+            // nodes are never shared between trees - the tree copies them itself.
+            pool(const pool & /*other*/) : pool() {}
+
+            pool(pool &&other) noexcept : chunks(std::move(other.chunks)) {
+                other.chunks.clear();
+            }
+
+            pool &operator=(const pool &other) {
+                if (this != &other) {
+                    clear();
+                }
+                return *this;
+            }
+
+            pool &operator=(pool &&other) noexcept {
+                if (this == &other) {
+                    return *this;
+                }
+                clear();
+                chunks = std::move(other.chunks);
+                other.chunks.clear();
+                return *this;
+            }
+
+            ~pool() { clear(); }
+
+            template<typename... Args>
+            link<Node> make(Args &&... args) {
+                if (chunks.empty() || chunks.back().used == chunks.back().capacity) {
+                    grow(next_capacity());
+                }
+                chunk &c = chunks.back();
+                Node *n = ::new (static_cast<void *>(&c.slots[c.used])) Node(std::forward<Args>(args)...);
+                ++c.used;
+                return n;
+            }
+
+            using ref = storage::arena::ref<Node>;
+
+            Node *get(link<Node> l) const { return l; }
+
+            ref ref_of(const Node *n) const { return const_cast<Node *>(n); }
+
+            void prefetch(const Node * /*n*/) const {}
+
+            bool reserve(size_t n) {
+                if (n != 0 && (chunks.empty() || chunks.back().capacity - chunks.back().used < n)) {
+                    grow(std::max(n, next_capacity()));
+                }
+                return false;  // a new chunk leaves the old ones in place
+            }
+
+            void release(link<Node> &root) {
+                clear();
+                root = nullptr;
+            }
+
+            void clear() {
+                if constexpr (!std::is_trivially_destructible_v<Node>) {
+                    for (chunk &c : chunks) {
+                        for (size_t i = 0; i < c.used; ++i) {
+                            std::destroy_at(std::launder(reinterpret_cast<Node *>(&c.slots[i])));
+                        }
+                    }
+                }
+                chunks.clear();
+            }
+        };
+    };
+
+    /**
+     * All nodes live in one std::vector and refer to their children by
+     * 32-bit index, so a node costs its value plus 8 bytes and the nodes of
+     * a tree sit in insertion order in a single block of memory.
+     * Growing the vector moves the nodes: node pointers are only valid until
+     * the next make() unless room was reserve()d for it.
+     */
+    struct indexed {
+        struct index {
+            static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max();
+            std::uint32_t i = npos;
+
+            bool operator==(const index &rhs) const = default;
+        };
+
+        template<typename Node>
+        using link = index;
+
+        template<typename Node>
+        using ref = index;
+
+        template<typename Node>
+        class pool {
+        private:
+            std::vector<Node> nodes;
+
+        public:
+            pool() = default;
+
+            // nodes are never shared between trees - the tree copies them itself.
+            pool(const pool & /*other*/) : pool() {}
+
+            pool(pool &&other) noexcept = default;
+
+            pool &operator=(const pool &other) {
+                if (this != &other) {
+                    clear();
+                }
+                return *this;
+            }
+
+            pool &operator=(pool &&other) noexcept = default;
+
+            ~pool() = default;
+
+            template<typename... Args>
+            index make(Args &&... args) {
+                if (nodes.size() >= index::npos) {
+                    throw std::length_error("Error: too many nodes for 32-bit indices.\n");
+                }
+                nodes.emplace_back(std::forward<Args>(args)...);
+                return index{static_cast<std::uint32_t>(nodes.size() - 1)};
+            }
+
+            using ref = storage::indexed::ref<Node>;
+
+            Node *get(index l) const {
+                if (l.i == index::npos) {
+                    return nullptr;
+                }
+                // the pool owns the nodes, constness is the tree's business.
+                return const_cast<Node *>(nodes.data() + l.i);
+            }
+
+            index ref_of(const Node *n) const {
+                return index{static_cast<std::uint32_t>(n - nodes.data())};
+            }
+
+            void prefetch(const Node * /*n*/) const {}
+
+            bool reserve(size_t n) {
+                if (nodes.capacity() - nodes.size() >= n) {
+                    return false;
+                }
+                nodes.reserve(std::max(nodes.size() + n, 2 * nodes.capacity()));
+                return true;
+            }
+
+            void release(index &root) {
+                clear();
+                root = index{};
+            }
+
+            void clear() { std::vector<Node>().swap(nodes); }
+        };
+    };
+
+    /**
+     * Base storage, with software prefetching: iterators and searches ask
+     * for the children of a node, and the next node on their stack, to be
+     * loaded into the cache while they work on the current one. Helps
+     * trees whose nodes are scattered in memory and don't fit in the cache;
+     * costs a few instructions per node otherwise.
+     * A no-op on compilers without __builtin_prefetch.
+     */
+    template<typename Base>
+    struct prefetched {
+        template<typename Node>
+        using link = typename Base::template link<Node>;
+
+        template<typename Node>
+        using ref = typename Base::template ref<Node>;
+
+        template<typename Node>
+        class pool : public Base::template pool<Node> {
+        public:
+            void prefetch(const Node *n) const {
+#if defined(__GNUC__) || defined(__clang__)
+                __builtin_prefetch(n);
+#else
+                (void) n;
+#endif
+            }
+        };
+    };
+
+}  // namespace ariel::storage
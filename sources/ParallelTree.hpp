@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BinaryTree.hpp"
+
+namespace ariel {
+
+    namespace detail {
+
+        /**
+         * Work stealing walk over the nodes of a tree, in no particular order.
+         *
+         * Each worker walks its subtree depth first with a private stack. While
+         * some worker is idle, the others hand it the oldest entry of their
+         * stack - the pending subtree closest to the root, so the largest one -
+         * through their shared deque, and idle workers steal from the front of
+         * the others' deques. Lopsided trees are split where the work is,
+         * balanced trees are hardly split at all.
+         *
+         * @param visit called as visit(worker, value), worker in [0, threads).
+         */
+        template<typename Cursor, typename Visit>
+        void parallel_walk(Cursor root, unsigned threads, Visit &visit) {
+            if (!root) {
+                return;
+            }
+            if (threads == 1) {  // nothing to share
+                std::vector<Cursor> stack{root};
+                while (!stack.empty()) {
+                    Cursor n = stack.back();
+                    stack.pop_back();
+                    visit(0u, *n);
+                    if (n.right()) {
+                        stack.push_back(n.right());
+                    }
+                    if (n.left()) {
+                        stack.push_back(n.left());
+                    }
+                }
+                return;
+            }
+            struct worker {
+                std::mutex lock;
+                std::deque<Cursor> tasks;
+            };
+            std::vector<worker> workers(threads);
+            std::atomic<size_t> pending{1};  // subtrees queued or being walked
+            std::atomic<unsigned> idle{0};
+            std::atomic<bool> failed{false};
+            std::exception_ptr error;
+            std::mutex error_lock;
+            workers[0].tasks.push_back(root);
+
+            auto take = [&](unsigned self, Cursor &task) {
+                for (unsigned i = 0; i < threads; ++i) {
+                    unsigned victim = (self + i) % threads;
+                    std::lock_guard<std::mutex> guard(workers[victim].lock);
+                    auto &tasks = workers[victim].tasks;
+                    if (!tasks.empty()) {
+                        // own work from the back (depth first), stolen work from the front (biggest)
+                        if (victim == self) {
+                            task = tasks.back();
+                            tasks.pop_back();
+                        } else {
+                            task = tasks.front();
+                            tasks.pop_front();
+                        }
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            auto run = [&](unsigned self) {
+                std::deque<Cursor> stack;
+                bool waiting = false;
+                while (pending.load() != 0 && !failed.load()) {
+                    Cursor task;
+                    if (!take(self, task)) {
+                        if (!waiting) {
+                            waiting = true;
+                            ++idle;
+                        }
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    if (waiting) {
+                        waiting = false;
+                        --idle;
+                    }
+                    try {
+                        stack.push_back(task);
+                        while (!stack.empty() && !failed.load()) {
+                            if (idle.load() != 0 && stack.size() > 1) {
+                                ++pending;
+                                std::lock_guard<std::mutex> guard(workers[self].lock);
+                                workers[self].tasks.push_back(stack.front());
+                                stack.pop_front();
+                            }
+                            Cursor n = stack.back();
+                            stack.pop_back();
+                            visit(self, *n);
+                            if (n.right()) {
+                                stack.push_back(n.right());
+                            }
+                            if (n.left()) {
+                                stack.push_back(n.left());
+                            }
+                        }
+                    } catch (...) {
+                        std::lock_guard<std::mutex> guard(error_lock);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        failed = true;
+                    }
+                    stack.clear();
+                    --pending;
+                }
+                if (waiting) {
+                    --idle;
+                }
+            };
+
+            std::vector<std::thread> pool;
+            pool.reserve(threads - 1);
+            for (unsigned i = 1; i < threads; ++i) {
+                pool.emplace_back(run, i);
+            }
+            run(0);
+            for (std::thread &t : pool) {
+                t.join();
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        inline unsigned thread_count(unsigned threads) {
+            if (threads == 0) {
+                threads = std::thread::hardware_concurrency();
+            }
+            return std::max(threads, 1u);
+        }
+
+    }  // namespace detail
+
+    /**
+     * Call f(value) on every value of the tree, from several threads, in no
+     * particular order. f gets a T& for a mutable tree and a const T& for a
+     * const one; it must not change the structure of the tree.
+     * If f throws, the walk stops and the first exception is rethrown.
+     * @param threads number of threads, 0 for one per core.
+     */
+    template<typename Tree, typename F>
+    void parallel_for_each(Tree &tree, F f, unsigned threads = 0) {
+        auto visit = [&f](unsigned /*worker*/, auto &value) { f(value); };
+        detail::parallel_walk(tree.root_cursor(), detail::thread_count(threads), visit);
+    }
+
+    /**
+     * Transform every value of the tree and reduce the results with reduce,
+     * from several threads, like std::transform_reduce: reduce must be
+     * associative and commutative, init is used once, and reduce(R, R) must
+     * give an R. Each thread starts its partial result from the first value
+     * it transforms, so there is no identity to provide.
+     * If transform or reduce throws, the walk stops and the first exception
+     * is rethrown.
+     * @param threads number of threads, 0 for one per core.
+     */
+    template<typename Tree, typename R, typename Reduce, typename Transform>
+    R parallel_transform_reduce(const Tree &tree, R init, Reduce reduce, Transform transform, unsigned threads = 0) {
+        threads = detail::thread_count(threads);
+        // one partial result per worker, each on its own cache line
+        struct alignas(64) partial {
+            std::optional<R> value;
+        };
+        std::vector<partial> partials(threads);
+        auto visit = [&](unsigned worker, const auto &value) {
+            std::optional<R> &acc = partials[worker].value;
+            if (acc) {
+                acc = reduce(std::move(*acc), transform(value));
+            } else {
+                acc.emplace(transform(value));
+            }
+        };
+        detail::parallel_walk(tree.root_cursor(), threads, visit);
+        for (partial &p : partials) {
+            if (p.value) {
+                init = reduce(std::move(init), std::move(*p.value));
+            }
+        }
+        return init;
+    }
+
+    /**
+     * Reduce all values of the tree with op, from several threads, like
+     * std::reduce: op must be associative and commutative, and init is used
+     * once. Values are converted to R first, so op only combines Rs; to
+     * map the values on the way, use parallel_transform_reduce.
+     * If op throws, the walk stops and the first exception is rethrown.
+     * @param threads number of threads, 0 for one per core.
+     */
+    template<typename Tree, typename R, typename Op>
+    R parallel_reduce(const Tree &tree, R init, Op op, unsigned threads = 0) {
+        return parallel_transform_reduce(
+                tree, std::move(init), std::move(op), [](const auto &value) { return R(value); }, threads);
+    }
+
+}  // namespace ariel
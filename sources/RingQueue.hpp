@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace ariel {
+
+    /**
+     * FIFO queue over a single power-of-two ring buffer. The buffer only
+     * grows, so a queue cleared and reused for the next traversal doesn't
+     * allocate again.
+     */
+    template<typename T>
+    class RingQueue {
+    private:
+        std::vector<T> ring;
+        size_t head;
+        size_t count;
+
+        size_t mask() const { return ring.size() - 1; }
+
+        void grow() {
+            std::vector<T> bigger(ring.empty() ? 16 : ring.size() * 2);
+            for (size_t i = 0; i < count; ++i) {
+                bigger[i] = std::move(ring[(head + i) & mask()]);
+            }
+            ring = std::move(bigger);
+            head = 0;
+        }
+
+    public:
+        RingQueue() : head(0), count(0) {}
+
+        bool empty() const { return count == 0; }
+
+        size_t size() const { return count; }
+
+        size_t capacity() const { return ring.size(); }
+
+        void push(const T &value) {
+            if (count == ring.size()) {
+                grow();
+            }
+            ring[(head + count) & mask()] = value;
+            ++count;
+        }
+
+        T &front() { return ring[head]; }
+
+        const T &front() const { return ring[head]; }
+
+        void pop() {
+            head = (head + 1) & mask();
+            --count;
+        }
+
+        /**
+         * Empty the queue, keeping the buffer.
+         */
+        void clear() {
+            head = 0;
+            count = 0;
+        }
+    };
+
+}  // namespace ariel
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BinaryTree.hpp"
+
+namespace ariel {
+
+    namespace detail {
+
+        // what has to be escaped in a value
+        enum class Escape { brackets, dot, json };
+
+        /**
+         * Collects text in one buffer and hands it to sink(std::string_view)
+         * in large blocks. Values are formatted straight into the buffer -
+         * numbers with std::to_chars, strings as they are, other types through
+         * one reused stream - and escaped on the way in, so no string is made
+         * per value.
+         */
+        template<typename Sink>
+        class BlockWriter {
+        private:
+            static constexpr size_t block = size_t{1} << 16;
+
+            Sink sink;
+            std::string out;
+            std::ostringstream scratch;  // for the values of user types
+
+            void escaped(std::string_view text, Escape escape) {
+                for (char c : text) {
+                    switch (escape) {
+                        case Escape::brackets:
+                            if (c == '(' || c == ')' || c == '\\') {
+                                out += '\\';
+                            }
+                            out += c;
+                            break;
+                        case Escape::dot:
+                            if (c == '"' || c == '\\') {
+                                out += '\\';
+                                out += c;
+                            } else if (c == '\n') {
+                                out += "\\n";
+                            } else {
+                                out += c;
+                            }
+                            break;
+                        case Escape::json:
+                            if (c == '"' || c == '\\') {
+                                out += '\\';
+                                out += c;
+                            } else if (static_cast<unsigned char>(c) < 0x20) {
+                                const char *hex = "0123456789abcdef";
+                                out += "\\u00";
+                                out += hex[(c >> 4) & 0xf];
+                                out += hex[c & 0xf];
+                            } else {
+                                out += c;
+                            }
+                            break;
+                    }
+                }
+            }
+
+        public:
+            explicit BlockWriter(Sink sink) : sink(std::move(sink)) { out.reserve(block + block / 4); }
+
+            BlockWriter(const BlockWriter &) = delete;
+
+            BlockWriter &operator=(const BlockWriter &) = delete;
+
+            ~BlockWriter() { flush(); }
+
+            void put(std::string_view text) {
+                out += text;
+                if (out.size() >= block) {
+                    flush();
+                }
+            }
+
+            void flush() {
+                sink(std::string_view(out));
+                out.clear();
+            }
+
+            /**
+             * Write a number, shortest form that reads back the same.
+             */
+            template<typename N>
+            void number(N n) {
+                char buffer[64];
+                auto end = std::to_chars(std::begin(buffer), std::end(buffer), n).ptr;
+                out.append(buffer, end);
+            }
+
+            /**
+             * Write value as text, escaped. Numbers and strings are written
+             * directly, other types are streamed with operator<<.
+             */
+            template<typename T>
+            void text(const T &value, Escape escape) {
+                if constexpr (std::is_same_v<T, bool>) {
+                    out += value ? "true" : "false";
+                } else if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char>) {
+                    number(value);
+                } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+                    escaped(std::string_view(value), escape);
+                } else {
+                    scratch.str("");
+                    scratch << value;
+                    escaped(scratch.view(), escape);
+                }
+                if (out.size() >= block) {
+                    flush();
+                }
+            }
+
+            /**
+             * Write value as a JSON value: numbers and booleans bare,
+             * non-finite numbers as null, anything else as a string.
+             */
+            template<typename T>
+            void json(const T &value) {
+                if constexpr (std::is_floating_point_v<T>) {
+                    if (!std::isfinite(value)) {
+                        put("null");
+                        return;
+                    }
+                }
+                if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char>) {
+                    text(value, Escape::json);
+                } else {
+                    out += '"';
+                    text(value, Escape::json);
+                    out += '"';
+                }
+            }
+        };
+
+        /**
+         * A sink that writes to os.
+         */
+        inline auto stream_sink(std::ostream &os) {
+            return [&os](std::string_view text) { os.write(text.data(), static_cast<std::streamsize>(text.size())); };
+        }
+
+        // the exporters, writing through sink(std::string_view) - see write_dot and friends
+
+        template<typename Sink, typename Tree>
+        void dot_to(Sink sink, const Tree &tree) {
+            using Cursor = decltype(tree.root_cursor());
+            struct frame {
+                Cursor node;
+                size_t parent;  // id of the parent, the node's own for the root
+                bool isRight;
+            };
+            BlockWriter<Sink> out(std::move(sink));
+            out.put("digraph BinaryTree {\n");
+            std::vector<frame> stack;
+            if (Cursor root = tree.root_cursor()) {
+                stack.push_back(frame{root, 0, false});
+            }
+            size_t next = 0;
+            while (!stack.empty()) {
+                auto [node, parent, isRight] = stack.back();
+                stack.pop_back();
+                size_t id = next++;
+                out.put("n");
+                out.number(id);
+                out.put(" [label=\"");
+                out.text(*node, Escape::dot);
+                out.put("\"];\n");
+                if (id != 0) {
+                    out.put("n");
+                    out.number(parent);
+                    out.put(isRight ? ":se -> n" : ":sw -> n");
+                    out.number(id);
+                    out.put(";\n");
+                }
+                if (Cursor r = node.right()) {
+                    stack.push_back(frame{r, id, true});
+                }
+                if (Cursor l = node.left()) {
+                    stack.push_back(frame{l, id, false});
+                }
+            }
+            out.put("}\n");
+        }
+
+        template<typename Sink, typename Tree>
+        void json_to(Sink sink, const Tree &tree) {
+            using Cursor = decltype(tree.root_cursor());
+            struct step {
+                Cursor node;  // empty for a bare piece of text
+                std::string_view text;  // written before the node
+            };
+            BlockWriter<Sink> out(std::move(sink));
+            Cursor root = tree.root_cursor();
+            if (!root) {
+                out.put("null");
+                return;
+            }
+            std::vector<step> stack{step{root, ""}};
+            while (!stack.empty()) {
+                auto [node, text] = stack.back();
+                stack.pop_back();
+                out.put(text);
+                if (!node) {
+                    continue;
+                }
+                out.put("{\"v\":");
+                out.json(*node);
+                stack.push_back(step{Cursor{}, "}"});
+                if (Cursor r = node.right()) {
+                    stack.push_back(step{r, ",\"r\":"});
+                }
+                if (Cursor l = node.left()) {
+                    stack.push_back(step{l, ",\"l\":"});
+                }
+            }
+        }
+
+        template<typename Sink, typename Tree>
+        void brackets_to(Sink sink, const Tree &tree) {
+            using Cursor = decltype(tree.root_cursor());
+            struct step {
+                Cursor node;  // empty for a bare piece of text
+                std::string_view text;  // written before the node
+            };
+            BlockWriter<Sink> out(std::move(sink));
+            std::vector<step> stack;
+            if (Cursor root = tree.root_cursor()) {
+                stack.push_back(step{root, ""});
+            }
+            while (!stack.empty()) {
+                auto [node, text] = stack.back();
+                stack.pop_back();
+                out.put(text);
+                if (!node) {
+                    continue;
+                }
+                out.text(*node, Escape::brackets);
+                Cursor l = node.left();
+                Cursor r = node.right();
+                if (l || r) {
+                    stack.push_back(step{Cursor{}, ")"});
+                    stack.push_back(step{r, "("});
+                    stack.push_back(step{Cursor{}, ")"});
+                    stack.push_back(step{l, "("});
+                }
+            }
+        }
+
+    }  // namespace detail
+
+    /**
+     * Write the tree in Graphviz DOT, for visualization:
+     *   digraph BinaryTree {
+     *   n0 [label="1"];
+     *   n0:sw -> n1;
+     *   ...
+     *   }
+     * Nodes are numbered in preorder; left edges leave the south west of
+     * the parent, right edges its south east.
+     */
+    template<typename Tree>
+    std::ostream &write_dot(std::ostream &os, const Tree &tree) {
+        detail::dot_to(detail::stream_sink(os), tree);
+        return os;
+    }
+
+    /**
+     * Write the tree as compact JSON: a node is {"v":value,"l":left,"r":right}
+     * without the children it doesn't have, an empty tree is null.
+     * Numbers and booleans are written bare, other values as strings.
+     */
+    template<typename Tree>
+    std::ostream &write_json(std::ostream &os, const Tree &tree) {
+        detail::json_to(detail::stream_sink(os), tree);
+        return os;
+    }
+
+    /**
+     * Write the tree in bracket notation: value(left)(right), the children
+     * only if the node has any, a missing one as (). Parentheses and
+     * backslashes in values are escaped with a backslash.
+     *   1(2(4)(5()(6)))(3)
+     */
+    template<typename Tree>
+    std::ostream &write_brackets(std::ostream &os, const Tree &tree) {
+        detail::brackets_to(detail::stream_sink(os), tree);
+        return os;
+    }
+
+}  // namespace ariel
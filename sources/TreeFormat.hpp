@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <version>
+
+#include "BinaryTree.hpp"
+#include "TreeExport.hpp"
+
+// std::formatter where the standard library has <format>, fmt::formatter
+// where {fmt} is installed - either, both or neither
+#if defined(__cpp_lib_format)
+#include <format>
+#define ARIEL_HAS_STD_FORMAT 1
+#endif
+#if __has_include(<fmt/format.h>)
+#include <fmt/format.h>
+#define ARIEL_HAS_FMT 1
+#endif
+
+namespace ariel::detail {
+
+    /**
+     * What a BinaryTree format spec asks for:
+     *   {} {:tree}                   the drawing of operator<<
+     *   {:pre} {:in} {:post}         the values in that order, as [1, 2, 3]
+     *   {:dot} {:json} {:brackets}   like write_dot, write_json, write_brackets
+     */
+    enum class TreeSpec { tree, pre, in, post, dot, json, brackets };
+
+    /**
+     * Read a spec from [it, end), up to the closing brace. Constexpr, so
+     * format strings are checked at compile time.
+     * @return false if the spec is unknown. it is left at the closing brace.
+     */
+    template<typename It>
+    constexpr bool parse_tree_spec(It &it, It end, TreeSpec &spec) {
+        It first = it;
+        while (it != end && *it != '}') {
+            ++it;
+        }
+        std::string_view word(first, it);
+        if (word.empty() || word == "tree") {
+            spec = TreeSpec::tree;
+        } else if (word == "pre") {
+            spec = TreeSpec::pre;
+        } else if (word == "in") {
+            spec = TreeSpec::in;
+        } else if (word == "post") {
+            spec = TreeSpec::post;
+        } else if (word == "dot") {
+            spec = TreeSpec::dot;
+        } else if (word == "json") {
+            spec = TreeSpec::json;
+        } else if (word == "brackets") {
+            spec = TreeSpec::brackets;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Right align what was appended to out since start in width characters.
+     */
+    inline void align_right(std::string &out, size_t start, size_t width) {
+        size_t len = out.size() - start;
+        if (len < width) {
+            out.insert(start, width - len, ' ');
+        }
+    }
+
+    /**
+     * Append value with operator<<, for types the format library can't
+     * format.
+     */
+    template<typename T>
+    void stream_value(std::string &out, const T &value) {
+        thread_local std::ostringstream stream;
+        stream.str("");
+        stream << value;
+        out += stream.view();
+    }
+
+    /**
+     * The values from it to end, as [1, 2, 3].
+     */
+    template<typename It, typename End, typename Sink, typename Cell>
+    void format_order(It it, End end, Sink &sink, Cell &cell) {
+        const size_t block = size_t{1} << 16;
+        std::string out = "[";
+        for (bool first = true; it != end; ++it, first = false) {
+            if (!first) {
+                out += ", ";
+            }
+            cell(out, *it, 0);
+            if (out.size() >= block) {
+                sink(std::string_view(out));
+                out.clear();
+            }
+        }
+        out += ']';
+        sink(std::string_view(out));
+    }
+
+    /**
+     * Format tree as spec asks, handing the text to sink(std::string_view)
+     * in large blocks, with cell(out, value, width) formatting the values.
+     */
+    template<typename Tree, typename Sink, typename Cell>
+    void format_tree(const Tree &tree, TreeSpec spec, Sink sink, Cell cell) {
+        switch (spec) {
+            case TreeSpec::tree:
+                tree.print_to(sink, cell);
+                break;
+            case TreeSpec::pre:
+                format_order(tree.cbegin_preorder(), tree.cend_preorder(), sink, cell);
+                break;
+            case TreeSpec::in:
+                format_order(tree.cbegin_inorder(), tree.cend_inorder(), sink, cell);
+                break;
+            case TreeSpec::post:
+                format_order(tree.cbegin_postorder(), tree.cend_postorder(), sink, cell);
+                break;
+            case TreeSpec::dot:
+                dot_to(sink, tree);
+                break;
+            case TreeSpec::json:
+                json_to(sink, tree);
+                break;
+            case TreeSpec::brackets:
+                brackets_to(sink, tree);
+                break;
+        }
+    }
+
+}  // namespace ariel::detail
+
+#ifdef ARIEL_HAS_STD_FORMAT
+/**
+ * std::format support: std::format("{:pre}", tree). Writes straight to the
+ * output iterator, without a stream. Values are formatted with their own
+ * std::formatter, or with operator<< if they have none.
+ */
+template<typename T, typename Storage, typename Lookup, typename Layout, typename Cache>
+struct std::formatter<ariel::BinaryTree<T, Storage, Lookup, Layout, Cache>, char> {
+    ariel::detail::TreeSpec spec = ariel::detail::TreeSpec::tree;
+
+    constexpr auto parse(std::format_parse_context &ctx) {
+        auto it = ctx.begin();
+        if (!ariel::detail::parse_tree_spec(it, ctx.end(), spec)) {
+            throw std::format_error("Error: BinaryTree format spec is one of tree, pre, in, post, dot, json, brackets.\n");
+        }
+        return it;
+    }
+
+    template<typename FormatContext>
+    auto format(const ariel::BinaryTree<T, Storage, Lookup, Layout, Cache> &tree, FormatContext &ctx) const {
+        auto out = ctx.out();
+        // format_to appends a block at once, where copy would push each char
+        auto sink = [&out](std::string_view text) { out = std::format_to(out, "{}", text); };
+        auto cell = [](std::string &text, const T &value, size_t width) {
+            size_t start = text.size();
+            if constexpr (std::is_default_constructible_v<std::formatter<T, char>>) {
+                std::format_to(std::back_inserter(text), "{}", value);
+            } else {
+                ariel::detail::stream_value(text, value);
+            }
+            ariel::detail::align_right(text, start, width);
+        };
+        ariel::detail::format_tree(tree, spec, sink, cell);
+        return out;
+    }
+};
+#endif
+
+#ifdef ARIEL_HAS_FMT
+/**
+ * {fmt} support: fmt::format("{:pre}", tree), like the std::formatter.
+ */
+template<typename T, typename Storage, typename Lookup, typename Layout, typename Cache>
+struct fmt::formatter<ariel::BinaryTree<T, Storage, Lookup, Layout, Cache>, char> {
+    ariel::detail::TreeSpec spec = ariel::detail::TreeSpec::tree;
+
+    constexpr auto parse(fmt::format_parse_context &ctx) {
+        auto it = ctx.begin();
+        if (!ariel::detail::parse_tree_spec(it, ctx.end(), spec)) {
+            throw fmt::format_error("Error: BinaryTree format spec is one of tree, pre, in, post, dot, json, brackets.\n");
+        }
+        return it;
+    }
+
+    template<typename FormatContext>
+    auto format(const ariel::BinaryTree<T, Storage, Lookup, Layout, Cache> &tree, FormatContext &ctx) const {
+        auto out = ctx.out();
+        auto sink = [&out](std::string_view text) { out = fmt::format_to(out, "{}", fmt::string_view(text)); };
+        auto cell = [](std::string &text, const T &value, size_t width) {
+            size_t start = text.size();
+            if constexpr (fmt::is_formattable<T>::value) {
+                fmt::format_to(std::back_inserter(text), "{}", value);
+            } else {
+                ariel::detail::stream_value(text, value);
+            }
+            ariel::detail::align_right(text, start, width);
+        };
+        ariel::detail::format_tree(tree, spec, sink, cell);
+        return out;
+    }
+};
+#endif
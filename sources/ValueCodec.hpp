@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/**
+ * How BinaryTree::serialize writes values and BinaryTree::deserialize reads
+ * them back.
+ *
+ * codec::value<T> exposes
+ *   write(out, value)  append value to a Writer,
+ *   read(in)           the next value of a Reader.
+ * Trivially copyable types and std::basic_string of them are covered; other
+ * types need a specialization of codec::value. Numbers keep the byte order
+ * of the machine, so files move only between machines that agree on it.
+ */
+namespace ariel::codec {
+
+    /**
+     * Collects bytes in one buffer and writes it to the stream in large
+     * blocks.
+     */
+    class Writer {
+    private:
+        static constexpr size_t block = size_t{1} << 16;
+        static constexpr size_t none = static_cast<size_t>(-1);
+
+        std::ostream &os;
+        std::string out;
+        size_t held = none;  // where the byte to fill in is
+
+    public:
+        explicit Writer(std::ostream &os) : os(os) { out.reserve(block); }
+
+        void put(const void *bytes, size_t n) {
+            out.append(static_cast<const char *>(bytes), n);
+            if (out.size() >= block && held == none) {
+                flush();
+            }
+        }
+
+        /**
+         * Leave room for a byte that is known only after what follows it;
+         * nothing is written to the stream until fill() gives it.
+         */
+        void hold() {
+            held = out.size();
+            out += '\0';
+        }
+
+        void fill(std::uint8_t byte) {
+            out[held] = static_cast<char>(byte);
+            held = none;
+            if (out.size() >= block) {
+                flush();
+            }
+        }
+
+        template<typename N>
+        void number(N n) { put(&n, sizeof(n)); }
+
+        void flush() {
+            os.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+            if (!os) {
+                throw std::runtime_error("Error: writing the tree failed.\n");
+            }
+        }
+    };
+
+    /**
+     * Reads bytes straight from the stream's buffer, without a sentry per
+     * read. Reads nothing past what it is asked for, so more data may
+     * follow in the stream.
+     */
+    class Reader {
+    private:
+        std::istream &is;
+
+    public:
+        explicit Reader(std::istream &is) : is(is) {}
+
+        void get(void *bytes, size_t n) {
+            auto count = static_cast<std::streamsize>(n);
+            if (is.rdbuf() == nullptr || is.rdbuf()->sgetn(static_cast<char *>(bytes), count) != count) {
+                is.setstate(std::ios::failbit | std::ios::eofbit);
+                throw std::runtime_error("Error: the serialized tree is cut short.\n");
+            }
+        }
+
+        template<typename N>
+        N number() {
+            std::array<std::byte, sizeof(N)> bytes;
+            get(bytes.data(), bytes.size());
+            return std::bit_cast<N>(bytes);
+        }
+    };
+
+    /**
+     * Trivially copyable values are written as their bytes.
+     */
+    template<typename T>
+    struct value {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "serialize needs a trivially copyable T, a string, or a specialization of ariel::codec::value");
+
+        static void write(Writer &out, const T &v) { out.put(&v, sizeof(T)); }
+
+        static T read(Reader &in) { return in.number<T>(); }
+    };
+
+    /**
+     * Strings are written as their length, then their characters.
+     */
+    template<typename C, typename Traits, typename Alloc>
+    struct value<std::basic_string<C, Traits, Alloc>> {
+        using string = std::basic_string<C, Traits, Alloc>;
+
+        static void write(Writer &out, const string &v) {
+            out.number(static_cast<std::uint64_t>(v.size()));
+            out.put(v.data(), v.size() * sizeof(C));
+        }
+
+        static string read(Reader &in) {
+            auto length = in.number<std::uint64_t>();
+            string v;
+            // grows as it is read, so a bad length fails on the stream, not
+            // on a huge allocation
+            const std::uint64_t chunk = 4096;
+            for (std::uint64_t done = 0; done < length;) {
+                auto n = static_cast<size_t>(std::min(chunk, length - done));
+                v.resize(v.size() + n);
+                in.get(v.data() + done, n * sizeof(C));
+                done += n;
+            }
+            return v;
+        }
+    };
+
+}  // namespace ariel::codec